@@ -0,0 +1,354 @@
+/*
+ * JsonBase64.h
+ *
+ * Base64 (RFC 4648, standard alphabet) codec for blob values. The bulk of the
+ * data is converted by SSSE3 or AVX2 kernels, chosen once at run time from the
+ * CPU features as for the string scan kernels, the remainder and CPUs without
+ * SSSE3 use the scalar code. Encoding pads with '=', decoding accepts input
+ * with and without padding.
+ */
+
+#ifndef JSON_BASE64_H_
+#define JSON_BASE64_H_
+
+#include "JsonStringScan.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	/*
+	 * A kernel converts whole blocks from the start of the input and returns the number
+	 * of input bytes it consumed, encode kernels a multiple of 3 and decode kernels a
+	 * multiple of 4. Decode kernels stop before the first block with an invalid character.
+	 */
+	typedef size_t (*Base64EncodeFunction)(const unsigned char* in, size_t length, char* out);
+	typedef size_t (*Base64DecodeFunction)(const char* in, size_t length, unsigned char* out);
+
+	const unsigned char kBase64Invalid = 0xFF;
+
+	inline const char* base64Alphabet() {
+		return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	}
+
+	inline unsigned char base64Value(char c) {
+		struct Table {
+			unsigned char values[256];
+
+			Table() {
+				for(unsigned i = 0; i < 256; i++)
+					values[i] = kBase64Invalid;
+				for(unsigned i = 0; i < 64; i++)
+					values[static_cast<unsigned char>(base64Alphabet()[i])] = static_cast<unsigned char>(i);
+			}
+		};
+		static const Table table;
+
+		return table.values[static_cast<unsigned char>(c)];
+	}
+
+	inline size_t base64EncodedLength(size_t length) {
+		return (length + 2) / 3 * 4;
+	}
+
+	inline size_t encodeBase64Scalar(const unsigned char* in, size_t length, char* out) {
+		const char* alphabet = base64Alphabet();
+
+		size_t i = 0;
+		for(; i + 3 <= length; i += 3) {
+			const uint32_t bits = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+			*out++ = alphabet[bits >> 18];
+			*out++ = alphabet[(bits >> 12) & 0x3F];
+			*out++ = alphabet[(bits >> 6) & 0x3F];
+			*out++ = alphabet[bits & 0x3F];
+		}
+
+		return i;
+	}
+
+	inline size_t decodeBase64Scalar(const char* in, size_t length, unsigned char* out) {
+		size_t i = 0;
+		for(; i + 4 <= length; i += 4) {
+			const uint32_t a = base64Value(in[i]);
+			const uint32_t b = base64Value(in[i + 1]);
+			const uint32_t c = base64Value(in[i + 2]);
+			const uint32_t d = base64Value(in[i + 3]);
+			if((a | b | c | d) & 0xC0)
+				break;
+
+			const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+			*out++ = static_cast<unsigned char>(bits >> 16);
+			*out++ = static_cast<unsigned char>(bits >> 8);
+			*out++ = static_cast<unsigned char>(bits);
+		}
+
+		return i;
+	}
+
+#ifdef JSON_SCAN_DISPATCH
+
+	/*
+	 * Kernels after W. Muła and D. Lemire, "Faster Base64 Encoding and Decoding
+	 * using AVX2 Instructions". Each 3 input bytes are spread to four 6 bit indices
+	 * by a byte shuffle and two multiplications, the indices are mapped to ASCII
+	 * with a shuffle table of offsets. Decoding classifies each character by its
+	 * nibbles, adds the offset of its range and packs the 6 bit values with
+	 * multiply-add instructions.
+	 */
+
+	__attribute__((target("ssse3")))
+	inline __m128i encodeBase64Block(__m128i in) {
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+		const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+		const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+		const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		const __m128i indices = _mm_or_si128(t1, t3);
+
+		__m128i offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		const __m128i lower = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		offsets = _mm_or_si128(offsets, _mm_and_si128(lower, _mm_set1_epi8(13)));
+
+		const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+		return _mm_add_epi8(_mm_shuffle_epi8(shift, offsets), indices);
+	}
+
+	// false if one of the 16 characters is not in the alphabet
+	__attribute__((target("ssse3")))
+	inline bool decodeBase64Block(__m128i in, __m128i & out) {
+		const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+		const __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), nibbleMask);
+		const __m128i low = _mm_and_si128(in, nibbleMask);
+
+		const __m128i lowClasses = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+				0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+		const __m128i highClasses = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+				0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lowClasses, low), _mm_shuffle_epi8(highClasses, high));
+		if(_mm_movemask_epi8(_mm_cmpgt_epi8(invalid, _mm_setzero_si128())))
+			return false;
+
+		const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+		const __m128i values = _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(slash, high)));
+
+		const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		const __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+		out = _mm_shuffle_epi8(triples, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		return true;
+	}
+
+	__attribute__((target("ssse3")))
+	inline size_t encodeBase64SSSE3(const unsigned char* in, size_t length, char* out) {
+		size_t i = 0;
+		// 16 bytes are loaded for 12 encoded
+		for(; i + 16 <= length; i += 12, out += 16) {
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), encodeBase64Block(block));
+		}
+
+		return i;
+	}
+
+	__attribute__((target("ssse3")))
+	inline size_t decodeBase64SSSE3(const char* in, size_t length, unsigned char* out) {
+		size_t i = 0;
+		// 16 bytes are stored for 12 decoded, the remaining input has to decode to at least 4 more
+		for(; i + 16 + 8 <= length; i += 16, out += 12) {
+			__m128i decoded;
+			if(!decodeBase64Block(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), decoded))
+				break;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), decoded);
+		}
+
+		return i;
+	}
+
+	__attribute__((target("avx2")))
+	inline size_t encodeBase64AVX2(const unsigned char* in, size_t length, char* out) {
+		const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+				1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+		const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+				'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+		size_t i = 0;
+		// each lane takes 12 bytes, 16 are loaded per lane
+		for(; i + 12 + 16 <= length; i += 24, out += 32) {
+			const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+			const __m256i s = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1), spread);
+
+			const __m256i t0 = _mm256_and_si256(s, _mm256_set1_epi32(0x0FC0FC00));
+			const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+			const __m256i t2 = _mm256_and_si256(s, _mm256_set1_epi32(0x003F03F0));
+			const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+			const __m256i indices = _mm256_or_si256(t1, t3);
+
+			__m256i offsets = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+			const __m256i lower = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+			offsets = _mm256_or_si256(offsets, _mm256_and_si256(lower, _mm256_set1_epi8(13)));
+
+			const __m256i encoded = _mm256_add_epi8(_mm256_shuffle_epi8(shift, offsets), indices);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), encoded);
+		}
+
+		return i + encodeBase64SSSE3(in + i, length - i, out);
+	}
+
+	__attribute__((target("avx2")))
+	inline size_t decodeBase64AVX2(const char* in, size_t length, unsigned char* out) {
+		const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+		const __m256i lowClasses = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+				0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+				0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+				0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+		const __m256i highClasses = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+				0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+				0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+				0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+		const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+				0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+		size_t i = 0;
+		// 32 bytes are stored for 24 decoded, the remaining input has to decode to at least 8 more
+		for(; i + 32 + 12 <= length; i += 32, out += 24) {
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			const __m256i high = _mm256_and_si256(_mm256_srli_epi32(s, 4), nibbleMask);
+			const __m256i low = _mm256_and_si256(s, nibbleMask);
+
+			const __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lowClasses, low), _mm256_shuffle_epi8(highClasses, high));
+			if(_mm256_movemask_epi8(_mm256_cmpgt_epi8(invalid, _mm256_setzero_si256())))
+				break;
+
+			const __m256i slash = _mm256_cmpeq_epi8(s, _mm256_set1_epi8('/'));
+			const __m256i values = _mm256_add_epi8(s, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(slash, high)));
+
+			const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+			const __m256i triples = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+			const __m256i packed = _mm256_shuffle_epi8(triples, pack);
+
+			// move the 12 bytes of the upper lane next to those of the lower lane
+			const __m256i decoded = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), decoded);
+		}
+
+		return i + decodeBase64SSSE3(in + i, length - i, out);
+	}
+
+#endif /* JSON_SCAN_DISPATCH */
+
+	inline Base64EncodeFunction selectEncodeBase64() {
+#ifdef JSON_SCAN_DISPATCH
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			return encodeBase64AVX2;
+		if(__builtin_cpu_supports("ssse3"))
+			return encodeBase64SSSE3;
+#endif
+		return encodeBase64Scalar;
+	}
+
+	inline Base64DecodeFunction selectDecodeBase64() {
+#ifdef JSON_SCAN_DISPATCH
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			return decodeBase64AVX2;
+		if(__builtin_cpu_supports("ssse3"))
+			return decodeBase64SSSE3;
+#endif
+		return decodeBase64Scalar;
+	}
+
+	/*
+	 * writes the base64 encoding of length bytes, base64EncodedLength(length)
+	 * characters, to out and returns the end of the written text
+	 */
+	inline char* encodeBase64(const unsigned char* in, size_t length, char* out) {
+		static const Base64EncodeFunction encode = selectEncodeBase64();
+
+		size_t i = encode(in, length, out);
+		i += encodeBase64Scalar(in + i, length - i, out + i / 3 * 4);
+		out += i / 3 * 4;
+
+		const char* alphabet = base64Alphabet();
+		if(length - i == 1) {
+			*out++ = alphabet[in[i] >> 2];
+			*out++ = alphabet[(in[i] & 0x03) << 4];
+			*out++ = '=';
+			*out++ = '=';
+		}
+		else if(length - i == 2) {
+			*out++ = alphabet[in[i] >> 2];
+			*out++ = alphabet[((in[i] & 0x03) << 4) | (in[i + 1] >> 4)];
+			*out++ = alphabet[(in[i + 1] & 0x0F) << 2];
+			*out++ = '=';
+		}
+
+		return out;
+	}
+
+	/*
+	 * length of the base64 text without padding and of the decoded data,
+	 * false if the length is not possible for base64
+	 */
+	inline bool base64DecodedLength(const char* in, size_t length, size_t & textLength, size_t & decodedLength) {
+		if(length % 4 == 0 && length > 0 && in[length - 1] == '=') {
+			length--;
+			if(in[length - 1] == '=')
+				length--;
+		}
+		if(length % 4 == 1)
+			return false;
+
+		textLength = length;
+		decodedLength = length / 4 * 3 + (length % 4 == 0 ? 0 : length % 4 - 1);
+		return true;
+	}
+
+	/*
+	 * decodes textLength characters of base64 text without padding to
+	 * out, which has room for the decoded length. Returns false if the
+	 * text has a character which is not in the alphabet.
+	 */
+	inline bool decodeBase64(const char* in, size_t textLength, unsigned char* out) {
+		static const Base64DecodeFunction decode = selectDecodeBase64();
+
+		size_t i = decode(in, textLength, out);
+		i += decodeBase64Scalar(in + i, textLength - i, out + i / 4 * 3);
+		out += i / 4 * 3;
+
+		const size_t rest = textLength - i;
+		if(rest >= 4)
+			return false;
+		if(rest == 0)
+			return true;
+
+		uint32_t bits = 0;
+		for(size_t j = 0; j < rest; j++) {
+			const uint32_t value = base64Value(in[i + j]);
+			if(value & 0xC0)
+				return false;
+			bits = (bits << 6) | value;
+		}
+
+		if(rest == 2) {
+			*out = static_cast<unsigned char>(bits >> 4);
+		}
+		else {
+			*out++ = static_cast<unsigned char>(bits >> 10);
+			*out = static_cast<unsigned char>(bits >> 2);
+		}
+		return true;
+	}
+
+}}}}
+
+#endif /* JSON_BASE64_H_ */
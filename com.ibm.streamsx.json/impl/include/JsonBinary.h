@@ -0,0 +1,1014 @@
+/*
+ * JsonBinary.h
+ *
+ * CBOR (RFC 8949) and MessagePack encodings of SPL tuples. Both are written from
+ * the write plans of the JSON writer and read through the EventHandler of the
+ * JSON reader, so types are mapped exactly as for JSON. Numbers and blobs are
+ * kept binary, which saves their formatting and parsing as text.
+ */
+
+#ifndef JSON_BINARY_H_
+#define JSON_BINARY_H_
+
+// the part of JsonReader.h defined per operator must not be included twice
+#ifndef JSON_READER_H_
+#include "JsonReader.h"
+#endif
+#include "JsonWriter.h"
+
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	// nesting depth at which a binary document is rejected, guards the recursive decoders
+	const unsigned kMaxBinaryDepth = 512;
+
+	/*
+	 * Output shared by the CBOR and MessagePack encoders. Containers are written with
+	 * their element count up front, values are appended big endian.
+	 */
+	class BinaryEncoder {
+	public:
+		uint32_t GetFlags() const { return flags_; }
+
+		/*
+		 * writes a timestamp as ISO-8601 UTC string
+		 */
+		void Iso8601(int64_t seconds, uint32_t nanoseconds, char* buffer, size_t & length) {
+			length = static_cast<size_t>(iso8601_.format(seconds, nanoseconds, buffer) - buffer);
+		}
+
+	protected:
+		BinaryEncoder(rapidjson::StringBuffer & buffer, uint32_t flags) : buffer_(buffer), flags_(flags) {}
+
+		void Put(unsigned char byte) {
+			*buffer_.Push(1) = static_cast<char>(byte);
+		}
+
+		void PutBigEndian(uint64_t value, size_t size) {
+			char* out = buffer_.Push(size);
+			for(size_t i = size; i > 0; i--) {
+				out[i - 1] = static_cast<char>(value & 0xff);
+				value >>= 8;
+			}
+		}
+
+		void PutBytes(const void* data, size_t size) {
+			if(size)
+				std::memcpy(buffer_.Push(size), data, size);
+		}
+
+		void PutFloat(float value) {
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			PutBigEndian(bits, 4);
+		}
+
+		void PutDouble(double value) {
+			uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			PutBigEndian(bits, 8);
+		}
+
+		/*
+		 * a double is written as float when no precision is lost, NaN and infinity included
+		 */
+		static bool IsFloat(double value) {
+			if(value != value || value == std::numeric_limits<double>::infinity() || value == -std::numeric_limits<double>::infinity())
+				return true;
+			if(value > FLT_MAX || value < -FLT_MAX)
+				return false;
+
+			return static_cast<double>(static_cast<float>(value)) == value;
+		}
+
+		/*
+		 * UTF-8 length of a UTF-16 string, a lone surrogate counts as U+FFFD
+		 */
+		static size_t UTF8Length(const UChar* str, size_t length) {
+			size_t size = 0;
+
+			const UChar* end = str + length;
+			while(str != end) {
+				const unsigned unit = *str++;
+
+				if(unit < 0x80)
+					size += 1;
+				else if(unit < 0x800)
+					size += 2;
+				else if(unit >= 0xD800 && unit <= 0xDBFF && str != end && *str >= 0xDC00 && *str <= 0xDFFF) {
+					str++;
+					size += 4;
+				}
+				else
+					size += 3;
+			}
+			return size;
+		}
+
+		/*
+		 * transcodes a UTF-16 string straight into the output as the JSON writer does,
+		 * size is its UTF8Length
+		 */
+		void PutUTF16(const UChar* str, size_t length, size_t size) {
+			rapidjson::PutReserve(buffer_, size);
+
+			const UChar* end = str + length;
+			while(str != end) {
+				unsigned codepoint = *str++;
+
+				if(codepoint < 0x80) {
+					rapidjson::PutUnsafe(buffer_, static_cast<char>(codepoint));
+					continue;
+				}
+
+				if(codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+					if(codepoint <= 0xDBFF && str != end && *str >= 0xDC00 && *str <= 0xDFFF)
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (*str++ - 0xDC00);
+					else
+						codepoint = 0xFFFD;
+				}
+				rapidjson::UTF8<>::EncodeUnsafe(buffer_, codepoint);
+			}
+		}
+
+		rapidjson::StringBuffer & buffer_;
+		uint32_t flags_;
+		Iso8601Format iso8601_;
+	};
+
+	class CborEncoder : public BinaryEncoder {
+	public:
+		CborEncoder(rapidjson::StringBuffer & buffer, uint32_t flags) : BinaryEncoder(buffer, flags) {}
+
+		void Null() { Put(0xf6); }
+		void Bool(bool b) { Put(b ? 0xf5 : 0xf4); }
+
+		void Int(int64_t i) {
+			if(i < 0)
+				Head(1, ~static_cast<uint64_t>(i));
+			else
+				Head(0, static_cast<uint64_t>(i));
+		}
+
+		void Uint(uint64_t u) { Head(0, u); }
+
+		void Float(float f) {
+			Put(0xfa);
+			PutFloat(f);
+		}
+
+		void Double(double d) {
+			if(IsFloat(d)) {
+				Float(static_cast<float>(d));
+			}
+			else {
+				Put(0xfb);
+				PutDouble(d);
+			}
+		}
+
+		void String(const char* str, size_t length) {
+			Head(3, length);
+			PutBytes(str, length);
+		}
+
+		void String(const UChar* str, size_t length) {
+			const size_t size = UTF8Length(str, length);
+			Head(3, size);
+			PutUTF16(str, length, size);
+		}
+
+		void Bytes(const unsigned char* data, size_t size) {
+			Head(2, size);
+			PutBytes(data, size);
+		}
+
+		void StartArray(size_t count) { Head(4, count); }
+		void StartMap(size_t count) { Head(5, count); }
+
+	private:
+		void Head(unsigned major, uint64_t value) {
+			const unsigned char type = static_cast<unsigned char>(major << 5);
+
+			if(value < 24) {
+				Put(type | static_cast<unsigned char>(value));
+			}
+			else if(value <= 0xff) {
+				Put(type | 24);
+				Put(static_cast<unsigned char>(value));
+			}
+			else if(value <= 0xffff) {
+				Put(type | 25);
+				PutBigEndian(value, 2);
+			}
+			else if(value <= 0xffffffffULL) {
+				Put(type | 26);
+				PutBigEndian(value, 4);
+			}
+			else {
+				Put(type | 27);
+				PutBigEndian(value, 8);
+			}
+		}
+	};
+
+	class MsgPackEncoder : public BinaryEncoder {
+	public:
+		MsgPackEncoder(rapidjson::StringBuffer & buffer, uint32_t flags) : BinaryEncoder(buffer, flags) {}
+
+		void Null() { Put(0xc0); }
+		void Bool(bool b) { Put(b ? 0xc3 : 0xc2); }
+
+		void Int(int64_t i) {
+			if(i >= 0)
+				Uint(static_cast<uint64_t>(i));
+			else if(i >= -32)
+				Put(static_cast<unsigned char>(i));
+			else if(i >= -0x80)
+				Sized(0xd0, static_cast<uint64_t>(i), 1);
+			else if(i >= -0x8000)
+				Sized(0xd1, static_cast<uint64_t>(i), 2);
+			else if(i >= -0x7fffffffLL - 1)
+				Sized(0xd2, static_cast<uint64_t>(i), 4);
+			else
+				Sized(0xd3, static_cast<uint64_t>(i), 8);
+		}
+
+		void Uint(uint64_t u) {
+			if(u <= 0x7f)
+				Put(static_cast<unsigned char>(u));
+			else if(u <= 0xff)
+				Sized(0xcc, u, 1);
+			else if(u <= 0xffff)
+				Sized(0xcd, u, 2);
+			else if(u <= 0xffffffffULL)
+				Sized(0xce, u, 4);
+			else
+				Sized(0xcf, u, 8);
+		}
+
+		void Float(float f) {
+			Put(0xca);
+			PutFloat(f);
+		}
+
+		void Double(double d) {
+			if(IsFloat(d)) {
+				Float(static_cast<float>(d));
+			}
+			else {
+				Put(0xcb);
+				PutDouble(d);
+			}
+		}
+
+		void String(const char* str, size_t length) {
+			StringHead(length);
+			PutBytes(str, length);
+		}
+
+		void String(const UChar* str, size_t length) {
+			const size_t size = UTF8Length(str, length);
+			StringHead(size);
+			PutUTF16(str, length, size);
+		}
+
+		void Bytes(const unsigned char* data, size_t size) {
+			Length(0xc4, size);
+			PutBytes(data, size);
+		}
+
+		void StartArray(size_t count) {
+			if(count < 16)
+				Put(0x90 | static_cast<unsigned char>(count));
+			else
+				Count(0xdc, count);
+		}
+
+		void StartMap(size_t count) {
+			if(count < 16)
+				Put(0x80 | static_cast<unsigned char>(count));
+			else
+				Count(0xde, count);
+		}
+
+	private:
+		void Sized(unsigned char type, uint64_t value, size_t size) {
+			Put(type);
+			PutBigEndian(value, size);
+		}
+
+		// str 8/16/32 and bin 8/16/32 follow each other
+		void Length(unsigned char type8, size_t length) {
+			if(length <= 0xff)
+				Sized(type8, length, 1);
+			else if(length <= 0xffff)
+				Sized(type8 + 1, length, 2);
+			else
+				Sized(type8 + 2, length, 4);
+		}
+
+		// fixstr up to 31 bytes, str 8/16/32 above
+		void StringHead(size_t length) {
+			if(length < 32)
+				Put(0xa0 | static_cast<unsigned char>(length));
+			else
+				Length(0xd9, length);
+		}
+
+		// array 16/32 and map 16/32 follow each other
+		void Count(unsigned char type16, size_t count) {
+			if(count <= 0xffff)
+				Sized(type16, count, 2);
+			else
+				Sized(type16 + 1, count, 4);
+		}
+	};
+
+
+	template<class Encoder>
+	inline void encodeString(Encoder & encoder, std::string const& str) {
+		encoder.String(str.data(), str.size());
+	}
+
+	template<class Encoder>
+	inline void encodeString(Encoder & encoder, SPL::ConstValueHandle const& valueHandle) {
+		switch(valueHandle.getMetaType()) {
+			case SPL::Meta::Type::BSTRING : {
+				const SPL::BString & str = valueHandle;
+				encoder.String(str.getCString(), str.getUsedSize());
+				break;
+			}
+			case SPL::Meta::Type::USTRING : {
+				const SPL::ustring & str = valueHandle;
+				encoder.String(str.getBuffer(), static_cast<size_t>(str.length()));
+				break;
+			}
+			default: {
+				const SPL::rstring & str = valueHandle;
+				encodeString(encoder, str);
+			}
+		}
+	}
+
+	template<class Encoder, typename T>
+	inline void encodeNumber(Encoder & encoder, T value) {
+		if(std::numeric_limits<T>::is_signed)
+			encoder.Int(static_cast<int64_t>(value));
+		else
+			encoder.Uint(static_cast<uint64_t>(value));
+	}
+
+	template<class Encoder>
+	inline void encodeNumber(Encoder & encoder, float value) { encoder.Float(value); }
+
+	template<class Encoder>
+	inline void encodeNumber(Encoder & encoder, double value) { encoder.Double(value); }
+
+	/*
+	 * decimals are encoded as their decimal string, as with kWriteDecimalAsString,
+	 * neither format has a number type keeping their exact digits
+	 */
+	template<class Encoder, typename Decimal>
+	inline void encodeDecimal(Encoder & encoder, SPL::ConstValueHandle const & valueHandle) {
+		const Decimal & value = valueHandle;
+		encodeString(encoder, SPL::spl_cast<SPL::rstring,Decimal>::cast(value));
+	}
+
+	template<class Encoder>
+	inline void encodeIso8601(Encoder & encoder, SPL::timestamp const & value) {
+		char buffer[kMaxIso8601Length + 8];
+		size_t length;
+		encoder.Iso8601(value.getSeconds(), value.getNanoseconds(), buffer, length);
+		encoder.String(buffer, length);
+	}
+
+	/*
+	 * timestamps follow the timestamp options as in writeTimestamp
+	 */
+	template<class Encoder>
+	inline void encodeTimestamp(Encoder & encoder, SPL::timestamp const & value) {
+		const uint32_t flags = encoder.GetFlags();
+		int64_t nanos, millis;
+
+		if(flags & kWriteTimestampISO8601)
+			encodeIso8601(encoder, value);
+		else if((flags & kWriteTimestampEpochNanos) && epochNanos(value.getSeconds(), value.getNanoseconds(), nanos))
+			encoder.Int(nanos);
+		else if(flags & (kWriteTimestampEpochMillis | kWriteTimestampEpochNanos)) {
+			if(epochMillis(value.getSeconds(), value.getNanoseconds(), millis))
+				encoder.Int(millis);
+			else
+				encodeIso8601(encoder, value);
+		}
+		else
+			encodeString(encoder, SPL::Functions::Time::ctime(value));
+	}
+
+	template<class Encoder>
+	inline void encodePrimitive(Encoder & encoder, SPL::Meta::Type type, SPL::ConstValueHandle const & valueHandle) {
+
+		switch (type) {
+			case SPL::Meta::Type::BOOLEAN : encoder.Bool(static_cast<const SPL::boolean &>(valueHandle)); break;
+			case SPL::Meta::Type::ENUM : encodeString(encoder, static_cast<const SPL::Enum &>(valueHandle).getValue()); break;
+			case SPL::Meta::Type::INT8 : encodeNumber(encoder, static_cast<const SPL::int8 &>(valueHandle)); break;
+			case SPL::Meta::Type::INT16 : encodeNumber(encoder, static_cast<const SPL::int16 &>(valueHandle)); break;
+			case SPL::Meta::Type::INT32 : encodeNumber(encoder, static_cast<const SPL::int32 &>(valueHandle)); break;
+			case SPL::Meta::Type::INT64 : encodeNumber(encoder, static_cast<const SPL::int64 &>(valueHandle)); break;
+			case SPL::Meta::Type::UINT8 : encodeNumber(encoder, static_cast<const SPL::uint8 &>(valueHandle)); break;
+			case SPL::Meta::Type::UINT16 : encodeNumber(encoder, static_cast<const SPL::uint16 &>(valueHandle)); break;
+			case SPL::Meta::Type::UINT32 : encodeNumber(encoder, static_cast<const SPL::uint32 &>(valueHandle)); break;
+			case SPL::Meta::Type::UINT64 : encodeNumber(encoder, static_cast<const SPL::uint64 &>(valueHandle)); break;
+			case SPL::Meta::Type::FLOAT32 : encodeNumber(encoder, static_cast<const SPL::float32 &>(valueHandle)); break;
+			case SPL::Meta::Type::FLOAT64 : encodeNumber(encoder, static_cast<const SPL::float64 &>(valueHandle)); break;
+			case SPL::Meta::Type::DECIMAL32 : encodeDecimal<Encoder,SPL::decimal32>(encoder, valueHandle); break;
+			case SPL::Meta::Type::DECIMAL64 : encodeDecimal<Encoder,SPL::decimal64>(encoder, valueHandle); break;
+			case SPL::Meta::Type::DECIMAL128 : encodeDecimal<Encoder,SPL::decimal128>(encoder, valueHandle); break;
+			case SPL::Meta::Type::TIMESTAMP : encodeTimestamp(encoder, static_cast<const SPL::timestamp &>(valueHandle)); break;
+			case SPL::Meta::Type::BSTRING :
+			case SPL::Meta::Type::RSTRING :
+			case SPL::Meta::Type::USTRING : encodeString(encoder, valueHandle); break;
+			case SPL::Meta::Type::BLOB : {
+				const SPL::blob & value = valueHandle;
+				encoder.Bytes(value.getData(), value.getSize());
+				break;
+			}
+			default:
+				// complex and xml values, as in JSON
+				encoder.Null();
+		}
+	}
+
+	template<class Encoder>
+	inline void encodeValue(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle);
+
+	/*
+	 * a list of a numeric type is a vector, its elements are encoded without value handles
+	 */
+	template<class Encoder, typename T>
+	inline void encodeNumberList(Encoder & encoder, SPL::ConstValueHandle const & valueHandle) {
+		const SPL::list<T> & values = valueHandle;
+
+		encoder.StartArray(values.size());
+		for(typename SPL::list<T>::const_iterator it = values.begin(); it != values.end(); ++it)
+			encodeNumber(encoder, *it);
+	}
+
+	template<class Encoder, typename Container, typename Iterator>
+	inline void encodeArray(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+		const Container & array = valueHandle;
+
+		encoder.StartArray(array.getSize());
+		for(Iterator arrayIter = array.getBeginIterator(); arrayIter != array.getEndIterator(); arrayIter++)
+			encodeValue(encoder, *plan.element, *arrayIter);
+	}
+
+	template<class Encoder>
+	inline void encodeList(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+
+		switch (plan.element->type) {
+			case SPL::Meta::Type::INT8 : encodeNumberList<Encoder,SPL::int8>(encoder, valueHandle); break;
+			case SPL::Meta::Type::INT16 : encodeNumberList<Encoder,SPL::int16>(encoder, valueHandle); break;
+			case SPL::Meta::Type::INT32 : encodeNumberList<Encoder,SPL::int32>(encoder, valueHandle); break;
+			case SPL::Meta::Type::INT64 : encodeNumberList<Encoder,SPL::int64>(encoder, valueHandle); break;
+			case SPL::Meta::Type::UINT8 : encodeNumberList<Encoder,SPL::uint8>(encoder, valueHandle); break;
+			case SPL::Meta::Type::UINT16 : encodeNumberList<Encoder,SPL::uint16>(encoder, valueHandle); break;
+			case SPL::Meta::Type::UINT32 : encodeNumberList<Encoder,SPL::uint32>(encoder, valueHandle); break;
+			case SPL::Meta::Type::UINT64 : encodeNumberList<Encoder,SPL::uint64>(encoder, valueHandle); break;
+			case SPL::Meta::Type::FLOAT32 : encodeNumberList<Encoder,SPL::float32>(encoder, valueHandle); break;
+			case SPL::Meta::Type::FLOAT64 : encodeNumberList<Encoder,SPL::float64>(encoder, valueHandle); break;
+			default: encodeArray<Encoder,SPL::List,SPL::ConstListIterator>(encoder, plan, valueHandle);
+		}
+	}
+
+	/*
+	 * maps and tuples are counted before they are written,
+	 * the entries skipped by the omit options are left out of the count
+	 */
+	template<class Encoder, typename Container, typename Iterator>
+	inline void encodeMap(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+		const uint32_t omit = encoder.GetFlags() & kWriteOmitMask;
+		const Container & map = valueHandle;
+
+		size_t count = map.getSize();
+		if(omit) {
+			for(Iterator mapIter = map.getBeginIterator(); mapIter != map.getEndIterator(); mapIter++) {
+				const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & mapHandle = *mapIter;
+				if(isOmitted(plan.element->type, mapHandle.second, omit))
+					count--;
+			}
+		}
+
+		encoder.StartMap(count);
+		for(Iterator mapIter = map.getBeginIterator(); mapIter != map.getEndIterator(); mapIter++) {
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & mapHandle = *mapIter;
+			if(omit && isOmitted(plan.element->type, mapHandle.second, omit))
+				continue;
+
+			encodeString(encoder, mapHandle.first);
+			encodeValue(encoder, *plan.element, mapHandle.second);
+		}
+	}
+
+	template<class Encoder>
+	inline void encodeTuple(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+		const uint32_t omit = encoder.GetFlags() & kWriteOmitMask;
+		const SPL::Tuple & tuple = valueHandle;
+
+		size_t count = plan.names.size();
+		if(omit) {
+			for(uint32_t i = 0; i < plan.names.size(); i++) {
+				if(isOmitted(plan.attributes[i]->type, tuple.getAttributeValue(i), omit))
+					count--;
+			}
+		}
+
+		encoder.StartMap(count);
+		for(uint32_t i = 0; i < plan.names.size(); i++) {
+			if(omit && isOmitted(plan.attributes[i]->type, tuple.getAttributeValue(i), omit))
+				continue;
+
+			encodeString(encoder, plan.names[i]);
+			encodeValue(encoder, *plan.attributes[i], tuple.getAttributeValue(i));
+		}
+	}
+
+	template<class Encoder>
+	inline void encodeValue(Encoder & encoder, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+
+		switch (plan.type) {
+			case SPL::Meta::Type::LIST : encodeList(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::BLIST : encodeArray<Encoder,SPL::BList,SPL::ConstListIterator>(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::SET : encodeArray<Encoder,SPL::Set,SPL::ConstSetIterator>(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::BSET : encodeArray<Encoder,SPL::BSet,SPL::ConstSetIterator>(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::MAP : encodeMap<Encoder,SPL::Map,SPL::ConstMapIterator>(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::BMAP : encodeMap<Encoder,SPL::BMap,SPL::ConstMapIterator>(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::TUPLE : encodeTuple(encoder, plan, valueHandle); break;
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & optional = valueHandle;
+
+				if(!optional.isPresent()) {
+					encoder.Null();
+				}
+				else if(plan.element) {
+					encodeValue(encoder, *plan.element, optional.getValue());
+				}
+				else {
+					// the composite type was null when the plan was built, use the cached plan of its type
+					const SPL::ConstValueHandle value = optional.getValue();
+					encodeValue(encoder, getWritePlan(value.getTypeId(), value, ""), value);
+				}
+				break;
+			}
+			default:
+				encodePrimitive(encoder, plan.type, valueHandle);
+		}
+	}
+
+	inline rapidjson::StringBuffer & getBinaryBuffer() {
+		static streams_boost::thread_specific_ptr<rapidjson::StringBuffer> bufferPtr_;
+
+		rapidjson::StringBuffer * buffer = bufferPtr_.get();
+		if(!buffer) {
+			bufferPtr_.reset(new rapidjson::StringBuffer());
+			buffer = bufferPtr_.get();
+		}
+
+		clearBuffer(*buffer);
+		return *buffer;
+	}
+
+	template<class Encoder>
+	inline SPL::blob tupleToBinary(SPL::Tuple const& tuple, uint32_t flags) {
+		rapidjson::StringBuffer & buffer = getBinaryBuffer();
+		Encoder encoder(buffer, flags);
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		encodeValue(encoder, getWritePlan(typeid(tuple), tupleHandle, ""), tupleHandle);
+
+		return SPL::blob(reinterpret_cast<const unsigned char*>(buffer.GetString()), buffer.GetSize());
+	}
+
+	inline SPL::blob tupleToCBOR(SPL::Tuple const& tuple, uint32_t flags = 0) {
+		return tupleToBinary<CborEncoder>(tuple, flags);
+	}
+
+	inline SPL::blob tupleToMsgPack(SPL::Tuple const& tuple, uint32_t flags = 0) {
+		return tupleToBinary<MsgPackEncoder>(tuple, flags);
+	}
+
+	template<class Options>
+	inline SPL::blob tupleToCBORWithOptions(SPL::Tuple const& tuple, Options const& options) {
+		return tupleToCBOR(tuple, getWriterFlags(options));
+	}
+
+	template<class Options>
+	inline SPL::blob tupleToMsgPackWithOptions(SPL::Tuple const& tuple, Options const& options) {
+		return tupleToMsgPack(tuple, getWriterFlags(options));
+	}
+
+
+	/*
+	 * Input shared by the CBOR and MessagePack decoders. Values are passed to a
+	 * RapidJSON SAX handler as the JSON reader would: integers as Uint or Int
+	 * when they fit 32 bits and as Uint64 or Int64 otherwise, strings copied
+	 * and zero terminated, byte strings as base64 strings.
+	 */
+	template<typename Handler>
+	class BinaryDecoder {
+	public:
+		size_t GetOffset() const { return static_cast<size_t>(p_ - begin_); }
+
+	protected:
+		BinaryDecoder(const unsigned char* data, size_t size) : begin_(data), p_(data), end_(data + size) {}
+
+		size_t Remaining() const { return static_cast<size_t>(end_ - p_); }
+
+		bool GetBigEndian(size_t size, uint64_t & value) {
+			if(Remaining() < size)
+				return false;
+
+			value = 0;
+			for(size_t i = 0; i < size; i++)
+				value = (value << 8) | *p_++;
+			return true;
+		}
+
+		bool GetFloat(double & value) {
+			uint64_t bits;
+			if(!GetBigEndian(4, bits))
+				return false;
+
+			const uint32_t bits32 = static_cast<uint32_t>(bits);
+			float f;
+			std::memcpy(&f, &bits32, sizeof(f));
+			value = f;
+			return true;
+		}
+
+		bool GetDouble(double & value) {
+			uint64_t bits;
+			if(!GetBigEndian(8, bits))
+				return false;
+
+			std::memcpy(&value, &bits, sizeof(value));
+			return true;
+		}
+
+		// appends bytes of the input to the scratch string
+		bool Append(uint64_t length) {
+			if(Remaining() < length)
+				return false;
+
+			scratch_.append(reinterpret_cast<const char*>(p_), static_cast<size_t>(length));
+			p_ += length;
+			return true;
+		}
+
+		bool Unsigned(Handler & handler, uint64_t u) {
+			if(u <= 0xffffffffULL)
+				return handler.Uint(static_cast<unsigned>(u));
+			return handler.Uint64(u);
+		}
+
+		bool Signed(Handler & handler, int64_t i) {
+			if(i >= 0)
+				return Unsigned(handler, static_cast<uint64_t>(i));
+			if(i >= -0x7fffffffLL - 1)
+				return handler.Int(static_cast<int>(i));
+			return handler.Int64(i);
+		}
+
+		bool String(Handler & handler) {
+			return handler.String(scratch_.c_str(), static_cast<rapidjson::SizeType>(scratch_.size()), true);
+		}
+
+		bool Key(Handler & handler) {
+			return handler.Key(scratch_.c_str(), static_cast<rapidjson::SizeType>(scratch_.size()), true);
+		}
+
+		bool Bytes(Handler & handler) {
+			return handler.Bytes(reinterpret_cast<const unsigned char*>(scratch_.data()), scratch_.size());
+		}
+
+		const unsigned char* begin_;
+		const unsigned char* p_;
+		const unsigned char* end_;
+		std::string scratch_;
+	};
+
+	template<typename Handler>
+	class CborDecoder : public BinaryDecoder<Handler> {
+	public:
+		CborDecoder(const unsigned char* data, size_t size) : BinaryDecoder<Handler>(data, size) {}
+
+		bool Parse(Handler & handler) { return Value(handler, 0); }
+
+	private:
+		typedef BinaryDecoder<Handler> Base;
+
+		static const unsigned kIndefinite = 31;
+
+		bool Argument(unsigned info, uint64_t & value) {
+			if(info < 24) {
+				value = info;
+				return true;
+			}
+			if(info > 27)
+				return false;
+
+			return this->GetBigEndian(size_t(1) << (info - 24), value);
+		}
+
+		bool Break() {
+			if(this->p_ < this->end_ && *this->p_ == 0xff) {
+				this->p_++;
+				return true;
+			}
+			return false;
+		}
+
+		/*
+		 * reads a byte or text string into the scratch string,
+		 * the chunks of an indefinite length string are joined
+		 */
+		bool StringValue(unsigned major, unsigned info) {
+			this->scratch_.clear();
+
+			uint64_t length;
+			if(info != kIndefinite)
+				return Argument(info, length) && this->Append(length);
+
+			while(!Break()) {
+				if(this->p_ == this->end_ || *this->p_ >> 5 != major || (*this->p_ & 0x1f) == kIndefinite)
+					return false;
+
+				const unsigned chunkInfo = *this->p_++ & 0x1f;
+				if(!Argument(chunkInfo, length) || !this->Append(length))
+					return false;
+			}
+			return true;
+		}
+
+		bool Simple(Handler & handler, unsigned info) {
+			double d;
+
+			switch(info) {
+				case 20 : return handler.Bool(false);
+				case 21 : return handler.Bool(true);
+				case 25 : {
+					uint64_t half;
+					if(!this->GetBigEndian(2, half))
+						return false;
+					return handler.Double(halfToDouble(static_cast<unsigned>(half)));
+				}
+				case 26 : return this->GetFloat(d) && handler.Double(d);
+				case 27 : return this->GetDouble(d) && handler.Double(d);
+				case 24 : {
+					// one byte simple value, unassigned
+					uint64_t simple;
+					return this->GetBigEndian(1, simple) && handler.Null();
+				}
+				case kIndefinite : return false;
+				default :
+					// null, undefined and unassigned simple values
+					return info < 28 && handler.Null();
+			}
+		}
+
+		static double halfToDouble(unsigned half) {
+			const int exponent = (half >> 10) & 0x1f;
+			const unsigned mantissa = half & 0x3ff;
+			double value;
+
+			if(exponent == 0)
+				value = std::ldexp(static_cast<double>(mantissa), -24);
+			else if(exponent != 31)
+				value = std::ldexp(static_cast<double>(mantissa + 1024), exponent - 25);
+			else
+				value = mantissa == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+
+			return (half & 0x8000) ? -value : value;
+		}
+
+		bool Value(Handler & handler, unsigned depth) {
+			if(depth > kMaxBinaryDepth || this->p_ == this->end_)
+				return false;
+
+			const unsigned initial = *this->p_++;
+			const unsigned major = initial >> 5;
+			const unsigned info = initial & 0x1f;
+			uint64_t argument = 0;
+
+			if(major == 7)
+				return Simple(handler, info);
+			if(major == 2 || major == 3) {
+				if(!StringValue(major, info))
+					return false;
+				return major == 2 ? this->Bytes(handler) : this->String(handler);
+			}
+			if(info != kIndefinite || major < 4 || major > 5) {
+				if(!Argument(info, argument))
+					return false;
+			}
+
+			switch(major) {
+				case 0 : return this->Unsigned(handler, argument);
+				case 1 : {
+					if(argument > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+						return handler.Double(-1.0 - static_cast<double>(argument));
+					return this->Signed(handler, -1 - static_cast<int64_t>(argument));
+				}
+				case 4 : {
+					if(!handler.StartArray())
+						return false;
+
+					rapidjson::SizeType count = 0;
+					if(info == kIndefinite) {
+						for(; !Break(); count++) {
+							if(!Value(handler, depth + 1))
+								return false;
+						}
+					}
+					else {
+						if(argument > this->Remaining())
+							return false;
+						for(; count < argument; count++) {
+							if(!Value(handler, depth + 1))
+								return false;
+						}
+					}
+					return handler.EndArray(count);
+				}
+				case 5 : {
+					if(!handler.StartObject())
+						return false;
+
+					rapidjson::SizeType count = 0;
+					if(info == kIndefinite) {
+						for(; !Break(); count++) {
+							if(!KeyValue(handler, depth))
+								return false;
+						}
+					}
+					else {
+						if(argument > this->Remaining())
+							return false;
+						for(; count < argument; count++) {
+							if(!KeyValue(handler, depth))
+								return false;
+						}
+					}
+					return handler.EndObject(count);
+				}
+				default :
+					// tags are skipped, the tagged value is read as is
+					return Value(handler, depth + 1);
+			}
+		}
+
+		// map keys have to be text strings, as JSON object keys
+		bool KeyValue(Handler & handler, unsigned depth) {
+			if(this->p_ == this->end_ || *this->p_ >> 5 != 3)
+				return false;
+
+			const unsigned info = *this->p_++ & 0x1f;
+			return StringValue(3, info) && this->Key(handler) && Value(handler, depth + 1);
+		}
+	};
+
+	template<typename Handler>
+	class MsgPackDecoder : public BinaryDecoder<Handler> {
+	public:
+		MsgPackDecoder(const unsigned char* data, size_t size) : BinaryDecoder<Handler>(data, size) {}
+
+		bool Parse(Handler & handler) { return Value(handler, 0); }
+
+	private:
+		bool StringValue(size_t lengthSize, uint64_t length) {
+			this->scratch_.clear();
+			return (lengthSize == 0 || this->GetBigEndian(lengthSize, length)) && this->Append(length);
+		}
+
+		bool Array(Handler & handler, uint64_t count, unsigned depth) {
+			if(count > this->Remaining() || !handler.StartArray())
+				return false;
+
+			for(uint64_t i = 0; i < count; i++) {
+				if(!Value(handler, depth + 1))
+					return false;
+			}
+			return handler.EndArray(static_cast<rapidjson::SizeType>(count));
+		}
+
+		bool Map(Handler & handler, uint64_t count, unsigned depth) {
+			if(count > this->Remaining() || !handler.StartObject())
+				return false;
+
+			for(uint64_t i = 0; i < count; i++) {
+				if(!KeyValue(handler, depth))
+					return false;
+			}
+			return handler.EndObject(static_cast<rapidjson::SizeType>(count));
+		}
+
+		// map keys have to be strings, as JSON object keys
+		bool KeyValue(Handler & handler, unsigned depth) {
+			if(this->p_ == this->end_)
+				return false;
+
+			const unsigned type = *this->p_++;
+			bool read;
+			if(type >= 0xa0 && type <= 0xbf)
+				read = StringValue(0, type & 0x1f);
+			else if(type >= 0xd9 && type <= 0xdb)
+				read = StringValue(size_t(1) << (type - 0xd9), 0);
+			else
+				return false;
+
+			return read && this->Key(handler) && Value(handler, depth + 1);
+		}
+
+		// extension types have no JSON equivalent, they are read as null
+		bool Extension(Handler & handler, size_t lengthSize, uint64_t length) {
+			if(lengthSize && !this->GetBigEndian(lengthSize, length))
+				return false;
+			if(this->Remaining() < length + 1)
+				return false;
+
+			this->p_ += length + 1;
+			return handler.Null();
+		}
+
+		bool Value(Handler & handler, unsigned depth) {
+			if(depth > kMaxBinaryDepth || this->p_ == this->end_)
+				return false;
+
+			const unsigned type = *this->p_++;
+			uint64_t value;
+			double d;
+
+			if(type <= 0x7f)
+				return handler.Uint(type);
+			if(type >= 0xe0)
+				return handler.Int(static_cast<int>(type) - 0x100);
+			if(type <= 0x8f)
+				return Map(handler, type & 0x0f, depth);
+			if(type <= 0x9f)
+				return Array(handler, type & 0x0f, depth);
+			if(type <= 0xbf)
+				return StringValue(0, type & 0x1f) && this->String(handler);
+
+			switch(type) {
+				case 0xc0 : return handler.Null();
+				case 0xc2 : return handler.Bool(false);
+				case 0xc3 : return handler.Bool(true);
+				case 0xc4 : case 0xc5 : case 0xc6 : return StringValue(size_t(1) << (type - 0xc4), 0) && this->Bytes(handler);
+				case 0xc7 : case 0xc8 : case 0xc9 : return Extension(handler, size_t(1) << (type - 0xc7), 0);
+				case 0xca : return this->GetFloat(d) && handler.Double(d);
+				case 0xcb : return this->GetDouble(d) && handler.Double(d);
+				case 0xcc : case 0xcd : case 0xce : case 0xcf :
+					return this->GetBigEndian(size_t(1) << (type - 0xcc), value) && this->Unsigned(handler, value);
+				case 0xd0 : case 0xd1 : case 0xd2 : case 0xd3 : {
+					const size_t size = size_t(1) << (type - 0xd0);
+					if(!this->GetBigEndian(size, value))
+						return false;
+					// sign extend from the encoded size
+					const unsigned shift = static_cast<unsigned>(64 - 8 * size);
+					return this->Signed(handler, static_cast<int64_t>(value << shift) >> shift);
+				}
+				case 0xd4 : case 0xd5 : case 0xd6 : case 0xd7 : case 0xd8 : return Extension(handler, 0, uint64_t(1) << (type - 0xd4));
+				case 0xd9 : case 0xda : case 0xdb : return StringValue(size_t(1) << (type - 0xd9), 0) && this->String(handler);
+				case 0xdc : case 0xdd : return this->GetBigEndian(size_t(2) << (type - 0xdc), value) && Array(handler, value, depth);
+				case 0xde : case 0xdf : return this->GetBigEndian(size_t(2) << (type - 0xde), value) && Map(handler, value, depth);
+				default : return false;
+			}
+		}
+	};
+
+	template<template<typename> class Decoder>
+	inline SPL::Tuple& extractFromBinary(SPL::blob const& data, SPL::Tuple & tuple) {
+
+		EventHandler handler(tuple);
+		Decoder<EventHandler> decoder(data.getData(), data.getSize());
+		if(!decoder.Parse(handler))
+			SPLAPPTRC(L_DEBUG, "parsing stopped at offset " << decoder.GetOffset(), "EXTRACT_FROM_JSON");
+
+		return tuple;
+	}
+
+	inline SPL::Tuple& extractFromCBOR(SPL::blob const& data, SPL::Tuple & tuple) {
+		return extractFromBinary<CborDecoder>(data, tuple);
+	}
+
+	inline SPL::Tuple& extractFromMsgPack(SPL::blob const& data, SPL::Tuple & tuple) {
+		return extractFromBinary<MsgPackDecoder>(data, tuple);
+	}
+
+}}}}
+
+#endif /* JSON_BINARY_H_ */
@@ -0,0 +1,230 @@
+/*
+ * JsonChunks.h
+ *
+ * Splitting of a stream of JSON documents received in chunks with arbitrary boundaries.
+ * The scanner keeps its state between chunks, the nesting depth and whether it is inside
+ * a string, an escape or a top level number or literal, so each byte is scanned once and
+ * a document is found complete as soon as its last byte arrives. Completed documents are
+ * then parsed once from the buffer, without being scanned again from their start.
+ */
+
+#ifndef JSON_CHUNKS_H_
+#define JSON_CHUNKS_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/error/error.h"
+#include "JsonLimits.h"
+#include "JsonStringScan.h"
+
+#include <deque>
+#include <limits>
+#include <string>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	class ChunkScanner {
+	public:
+		/*
+		 * A completed document, its bytes are [begin, end) of the buffer.
+		 * A document exceeding the size limit is dropped while it is received and kept as an error.
+		 */
+		struct Document {
+			size_t begin;
+			size_t end;
+			rapidjson::ParseErrorCode error;
+		};
+
+		ChunkScanner() { Reset(); }
+
+		void Reset() {
+			buffer_.clear();
+			documents_.clear();
+			consumed_ = 0;
+			pos_ = 0;
+			start_ = npos;
+			depth_ = 0;
+			inString_ = false;
+			inEscape_ = false;
+			inScalar_ = false;
+			tooBig_ = false;
+			maxBytes_ = std::numeric_limits<uint64_t>::max();
+		}
+
+		/*
+		 * Appends a chunk and scans it, a pending document larger than maxBytes is dropped.
+		 */
+		void Feed(const char* data, size_t size, uint64_t maxBytes) {
+			Compact();
+
+			maxBytes_ = maxBytes;
+			buffer_.append(data, size);
+			while(pos_ < buffer_.size()) {
+				const size_t end = Scan();
+
+				if(start_ != npos && end - start_ > maxBytes) {
+					// drop what was received of the document, it is only scanned to find its end
+					buffer_.erase(start_, end - start_);
+					pos_ = start_;
+					tooBig_ = true;
+				}
+			}
+		}
+
+		/*
+		 * Takes the next completed document, its bytes stay valid until the next call to Feed or Reset.
+		 */
+		bool Next(Document & document) {
+			if(documents_.empty())
+				return false;
+
+			document = documents_.front();
+			documents_.pop_front();
+			consumed_ = document.end;
+			return true;
+		}
+
+		const char* Data() const { return buffer_.data(); }
+
+		// bytes received and not yet taken as a document
+		size_t Pending() const { return buffer_.size() - consumed_; }
+
+	private:
+		static const size_t npos = static_cast<size_t>(-1);
+
+		/*
+		 * Scans from pos_ until a document completes or the buffer ends, returns the scanned end.
+		 */
+		size_t Scan() {
+			const char* data = buffer_.data();
+			const size_t size = buffer_.size();
+			const size_t documents = documents_.size();
+
+			while(pos_ < size && documents_.size() == documents) {
+				if(inString_) {
+					if(inEscape_) {
+						inEscape_ = false;
+						pos_++;
+						continue;
+					}
+
+					pos_ += scanEscape(data + pos_, size - pos_);
+					if(pos_ == size)
+						break;
+
+					if(data[pos_] == '\\')
+						inEscape_ = true;
+					else if(data[pos_] == '"') {
+						inString_ = false;
+						if(depth_ == 0)
+							Complete(pos_ + 1);
+					}
+					pos_++;
+					continue;
+				}
+
+				const char c = data[pos_];
+				if(inScalar_) {
+					if(!IsScalarEnd(c)) {
+						pos_++;
+						continue;
+					}
+
+					inScalar_ = false;
+					Complete(pos_);
+					break;
+				}
+
+				switch(c) {
+					case ' ': case '\t': case '\n': case '\r':
+						break;
+					case '{': case '[':
+						Start();
+						depth_++;
+						break;
+					case '}': case ']':
+						Start();
+						if(depth_ == 0 || --depth_ == 0)
+							Complete(pos_ + 1);
+						break;
+					case '"':
+						Start();
+						inString_ = true;
+						break;
+					default:
+						if(depth_ == 0) {
+							Start();
+							inScalar_ = true;
+						}
+						break;
+				}
+				pos_++;
+			}
+
+			return pos_;
+		}
+
+		static bool IsScalarEnd(char c) {
+			switch(c) {
+				case ' ': case '\t': case '\n': case '\r':
+				case '{': case '}': case '[': case ']': case '"': case ',': case ':':
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		void Start() {
+			if(start_ == npos)
+				start_ = pos_;
+		}
+
+		/*
+		 * Takes the document ending at end, a document completed within the chunk
+		 * it started in was not checked against the size limit while it was scanned.
+		 */
+		void Complete(size_t end) {
+			const bool tooBig = tooBig_ || end - start_ > maxBytes_;
+
+			Document document = { start_, end, tooBig ? kParseErrorDocumentTooBig : rapidjson::kParseErrorNone };
+			if(tooBig)
+				document.end = start_;
+
+			documents_.push_back(document);
+			start_ = npos;
+			tooBig_ = false;
+		}
+
+		/*
+		 * Drops the bytes of the documents taken, at most once per size of the remaining bytes
+		 */
+		void Compact() {
+			if(consumed_ == 0 || consumed_ < buffer_.size() - consumed_)
+				return;
+
+			buffer_.erase(0, consumed_);
+			for(std::deque<Document>::iterator it = documents_.begin(); it != documents_.end(); ++it) {
+				it->begin -= consumed_;
+				it->end -= consumed_;
+			}
+			pos_ -= consumed_;
+			if(start_ != npos)
+				start_ -= consumed_;
+			consumed_ = 0;
+		}
+
+		std::string buffer_;
+		std::deque<Document> documents_;
+		size_t consumed_;
+		size_t pos_;
+		size_t start_;
+		uint64_t depth_;
+		bool inString_;
+		bool inEscape_;
+		bool inScalar_;
+		bool tooBig_;
+		uint64_t maxBytes_;
+	};
+
+}}}}
+
+#endif /* JSON_CHUNKS_H_ */
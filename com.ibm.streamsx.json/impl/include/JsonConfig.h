@@ -0,0 +1,17 @@
+/*
+ * JsonConfig.h
+ *
+ * Configuration of RapidJSON shared by all headers of the toolkit. It has to be
+ * included before any RapidJSON header, so every header including RapidJSON
+ * includes it first.
+ */
+
+#ifndef JSON_CONFIG_H_
+#define JSON_CONFIG_H_
+
+// SSE2 is part of the x86-64 baseline, enable the RapidJSON SSE2 code paths
+#if defined(__SSE2__) && !defined(RAPIDJSON_SSE2) && !defined(RAPIDJSON_SSE42)
+#define RAPIDJSON_SSE2
+#endif
+
+#endif /* JSON_CONFIG_H_ */
@@ -0,0 +1,130 @@
+/*
+ * JsonHash.h
+ *
+ * 128 bit content hash of serialized JSON, MurmurHash3 x64_128 with seed 0.
+ * The hash is fed block by block, so it can be computed over a document
+ * written in pieces. The 64 bit hash is the first half of the 128 bit hash.
+ */
+
+#ifndef JSON_HASH_H_
+#define JSON_HASH_H_
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	class ContentHash {
+	public:
+		ContentHash() : h1_(0), h2_(0), length_(0), pending_(0) {}
+
+		void update(const char* data, size_t length) {
+			length_ += length;
+
+			if(pending_) {
+				const size_t count = length < 16 - pending_ ? length : 16 - pending_;
+				std::memcpy(block_ + pending_, data, count);
+				pending_ += count;
+				data += count;
+				length -= count;
+
+				if(pending_ < 16)
+					return;
+				mixBlock(block_);
+				pending_ = 0;
+			}
+
+			for(; length >= 16; data += 16, length -= 16)
+				mixBlock(data);
+
+			std::memcpy(block_, data, length);
+			pending_ = length;
+		}
+
+		void finish(uint64_t & high, uint64_t & low) const {
+			uint64_t h1 = h1_;
+			uint64_t h2 = h2_;
+			uint64_t k1 = 0;
+			uint64_t k2 = 0;
+
+			const unsigned char* tail = reinterpret_cast<const unsigned char*>(block_);
+			for(size_t i = pending_; i > 8; i--)
+				k2 = (k2 << 8) | tail[i - 1];
+			for(size_t i = pending_ < 8 ? pending_ : 8; i > 0; i--)
+				k1 = (k1 << 8) | tail[i - 1];
+
+			if(pending_ > 8) {
+				k2 *= kC2; k2 = rotl(k2, 33); k2 *= kC1; h2 ^= k2;
+			}
+			if(pending_ > 0) {
+				k1 *= kC1; k1 = rotl(k1, 31); k1 *= kC2; h1 ^= k1;
+			}
+
+			h1 ^= length_;
+			h2 ^= length_;
+
+			h1 += h2;
+			h2 += h1;
+
+			h1 = fmix(h1);
+			h2 = fmix(h2);
+
+			h1 += h2;
+			h2 += h1;
+
+			high = h1;
+			low = h2;
+		}
+
+		uint64_t finish64() const {
+			uint64_t high, low;
+			finish(high, low);
+			return high;
+		}
+
+	private:
+		static const uint64_t kC1 = 0x87c37b91114253d5ULL;
+		static const uint64_t kC2 = 0x4cf5ad432745937fULL;
+
+		static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+		static uint64_t fmix(uint64_t k) {
+			k ^= k >> 33;
+			k *= 0xff51afd7ed558ccdULL;
+			k ^= k >> 33;
+			k *= 0xc4ceb9fe1a85ec53ULL;
+			k ^= k >> 33;
+			return k;
+		}
+
+		static uint64_t load64(const char* p) {
+			uint64_t value;
+			std::memcpy(&value, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			value = __builtin_bswap64(value);
+#endif
+			return value;
+		}
+
+		void mixBlock(const char* block) {
+			uint64_t k1 = load64(block);
+			uint64_t k2 = load64(block + 8);
+
+			k1 *= kC1; k1 = rotl(k1, 31); k1 *= kC2; h1_ ^= k1;
+			h1_ = rotl(h1_, 27); h1_ += h2_; h1_ = h1_ * 5 + 0x52dce729;
+
+			k2 *= kC2; k2 = rotl(k2, 33); k2 *= kC1; h2_ ^= k2;
+			h2_ = rotl(h2_, 31); h2_ += h1_; h2_ = h2_ * 5 + 0x38495ab5;
+		}
+
+		uint64_t h1_;
+		uint64_t h2_;
+		uint64_t length_;
+		size_t pending_;
+		char block_[16];
+	};
+
+}}}}
+
+#endif /* JSON_HASH_H_ */
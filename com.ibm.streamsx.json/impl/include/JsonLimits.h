@@ -0,0 +1,240 @@
+/*
+ * JsonLimits.h
+ *
+ * Per thread limits on the JSON text read by parseJSON, extractFromJSON and parseJSONToBlob.
+ * The size of the text is checked before parsing, nesting depth, member and element counts
+ * and string lengths are checked on the SAX events, before the parser descends into a
+ * container or the value is stored, so hostile input is rejected before it costs stack or memory.
+ * Without limits the text is parsed exactly as before, the events are not wrapped.
+ */
+
+#ifndef JSON_LIMITS_H_
+#define JSON_LIMITS_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/reader.h"
+
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <streams_boost/thread/tss.hpp>
+
+#include <SPL/Runtime/Type/Tuple.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	/*
+	 * Parse errors of the limits, they follow the rapidjson::ParseErrorCode values
+	 * in JsonParseStatus.status
+	 */
+	const rapidjson::ParseErrorCode kParseErrorDocumentTooBig = static_cast<rapidjson::ParseErrorCode>(rapidjson::kParseErrorUnspecificSyntaxError + 1);
+	const rapidjson::ParseErrorCode kParseErrorNestingTooDeep = static_cast<rapidjson::ParseErrorCode>(rapidjson::kParseErrorUnspecificSyntaxError + 2);
+	const rapidjson::ParseErrorCode kParseErrorContainerTooBig = static_cast<rapidjson::ParseErrorCode>(rapidjson::kParseErrorUnspecificSyntaxError + 3);
+	const rapidjson::ParseErrorCode kParseErrorStringTooLong = static_cast<rapidjson::ParseErrorCode>(rapidjson::kParseErrorUnspecificSyntaxError + 4);
+
+	// the limit errors are not values of rapidjson::ParseErrorCode, so they are compared instead of switched on
+	inline const char* getParseErrorString(rapidjson::ParseErrorCode code) {
+		if(code == kParseErrorDocumentTooBig) return "The document exceeds the maximum size.";
+		if(code == kParseErrorNestingTooDeep) return "The document exceeds the maximum nesting depth.";
+		if(code == kParseErrorContainerTooBig) return "An object or array exceeds the maximum number of members or elements.";
+		if(code == kParseErrorStringTooLong) return "A string or key exceeds the maximum length.";
+		return rapidjson::GetParseError_En(code);
+	}
+
+	struct ParseLimits {
+
+		ParseLimits() : maxBytes(std::numeric_limits<uint64_t>::max()), maxDepth(std::numeric_limits<uint32_t>::max()),
+						maxMembers(std::numeric_limits<uint32_t>::max()), maxStringLength(std::numeric_limits<uint32_t>::max()),
+						iterative(false) {}
+
+		bool IsSet() const {
+			return iterative || maxBytes != std::numeric_limits<uint64_t>::max() || IsEventLimitSet();
+		}
+
+		bool IsEventLimitSet() const {
+			return maxDepth != std::numeric_limits<uint32_t>::max() || maxMembers != std::numeric_limits<uint32_t>::max()
+				|| maxStringLength != std::numeric_limits<uint32_t>::max();
+		}
+
+		uint64_t maxBytes;
+		uint32_t maxDepth;
+		uint32_t maxMembers;
+		uint32_t maxStringLength;
+		bool iterative;
+
+		// member or element count and array flag per open container, reused by the parses of the thread
+		std::vector<std::pair<uint32_t, bool> > counts;
+	};
+
+	inline ParseLimits & getParseLimits() {
+		static streams_boost::thread_specific_ptr<ParseLimits> limitsPtr_;
+
+		ParseLimits * limitsPtr = limitsPtr_.get();
+		if(!limitsPtr) {
+			limitsPtr_.reset(new ParseLimits());
+			limitsPtr = limitsPtr_.get();
+		}
+
+		return *limitsPtr;
+	}
+
+	/*
+	 * Sets the parse limits of the calling thread, 0 stands for no limit.
+	 */
+	inline void setJSONParseLimits(uint64_t maxBytes, uint32_t maxDepth, uint32_t maxMembers, uint32_t maxStringLength) {
+		ParseLimits & limits = getParseLimits();
+
+		limits.maxBytes = maxBytes ? maxBytes : std::numeric_limits<uint64_t>::max();
+		limits.maxDepth = maxDepth ? maxDepth : std::numeric_limits<uint32_t>::max();
+		limits.maxMembers = maxMembers ? maxMembers : std::numeric_limits<uint32_t>::max();
+		limits.maxStringLength = maxStringLength ? maxStringLength : std::numeric_limits<uint32_t>::max();
+	}
+
+	/*
+	 * Selects the iterative parser of the calling thread, its stack use does not depend on the nesting depth.
+	 */
+	inline void setJSONParseIterative(SPL::boolean iterative) {
+		getParseLimits().iterative = iterative;
+	}
+
+	/*
+	 * Forwards the SAX events to a handler and stops the parser once a limit is exceeded.
+	 * The member count of an object is checked on its keys, the element count of an array on its values.
+	 */
+	template<typename Handler>
+	class LimitHandler {
+	public:
+		typedef typename Handler::Ch Ch;
+
+		LimitHandler(Handler & handler, ParseLimits & limits) : handler_(handler), limits_(limits), error_(rapidjson::kParseErrorNone), counts_(limits.counts) {
+			counts_.clear();
+		}
+
+		bool Null() { return Value() && handler_.Null(); }
+		bool Bool(bool b) { return Value() && handler_.Bool(b); }
+		bool Int(int i) { return Value() && handler_.Int(i); }
+		bool Uint(unsigned u) { return Value() && handler_.Uint(u); }
+		bool Int64(int64_t i) { return Value() && handler_.Int64(i); }
+		bool Uint64(uint64_t u) { return Value() && handler_.Uint64(u); }
+		bool Double(double d) { return Value() && handler_.Double(d); }
+		bool RawNumber(const Ch* str, rapidjson::SizeType length, bool copy) { return Value() && handler_.RawNumber(str, length, copy); }
+		bool String(const Ch* str, rapidjson::SizeType length, bool copy) { return Value() && Length(length) && handler_.String(str, length, copy); }
+
+		bool StartObject() { return Value() && Enter(false) && handler_.StartObject(); }
+		bool Key(const Ch* str, rapidjson::SizeType length, bool copy) { return Count() && Length(length) && handler_.Key(str, length, copy); }
+		bool EndObject(rapidjson::SizeType memberCount) { counts_.pop_back(); return handler_.EndObject(memberCount); }
+
+		bool StartArray() { return Value() && Enter(true) && handler_.StartArray(); }
+		bool EndArray(rapidjson::SizeType elementCount) { counts_.pop_back(); return handler_.EndArray(elementCount); }
+
+		rapidjson::ParseErrorCode GetError() const { return error_; }
+
+	private:
+		// values of an array are counted, values of an object were counted on their key
+		bool Value() { return counts_.empty() || !counts_.back().second || Count(); }
+
+		bool Count() {
+			if(counts_.empty() || ++counts_.back().first <= limits_.maxMembers)
+				return true;
+			return Fail(kParseErrorContainerTooBig);
+		}
+
+		bool Enter(bool array) {
+			if(counts_.size() >= limits_.maxDepth)
+				return Fail(kParseErrorNestingTooDeep);
+
+			counts_.push_back(std::make_pair(0u, array));
+			return true;
+		}
+
+		bool Length(rapidjson::SizeType length) {
+			return length <= limits_.maxStringLength || Fail(kParseErrorStringTooLong);
+		}
+
+		bool Fail(rapidjson::ParseErrorCode error) {
+			error_ = error;
+			return false;
+		}
+
+		Handler & handler_;
+		ParseLimits const& limits_;
+		rapidjson::ParseErrorCode error_;
+		std::vector<std::pair<uint32_t, bool> > & counts_;
+	};
+
+	/*
+	 * Checks whether the text ahead of a stream is longer than the given number of bytes,
+	 * a zero terminated text is scanned no further than that.
+	 */
+	inline bool isLongerThan(rapidjson::StringStream const& jsonStream, uint64_t bytes) {
+		return strnlen(jsonStream.src_, bytes + 1) > bytes;
+	}
+
+	inline bool isLongerThan(rapidjson::MemoryStream const& jsonStream, uint64_t bytes) {
+		return static_cast<uint64_t>(jsonStream.end_ - jsonStream.src_) > bytes;
+	}
+
+	template<unsigned parseFlags, typename Reader, typename Stream, typename Handler>
+	inline rapidjson::ParseResult parseStream(Reader & reader, Stream & jsonStream, Handler & handler, bool iterative) {
+		return iterative
+			? reader.template Parse<parseFlags | rapidjson::kParseIterativeFlag>(jsonStream, handler)
+			: reader.template Parse<parseFlags>(jsonStream, handler);
+	}
+
+	/*
+	 * Parses a stream into a handler within the parse limits of the calling thread.
+	 */
+	template<unsigned parseFlags, typename SourceEncoding, typename Stream, typename Handler>
+	inline rapidjson::ParseResult parseWithLimits(Stream & jsonStream, Handler & handler) {
+		rapidjson::GenericReader<SourceEncoding, rapidjson::UTF8<> > reader;
+
+		ParseLimits & limits = getParseLimits();
+		if(!limits.IsSet())
+			return reader.template Parse<parseFlags>(jsonStream, handler);
+
+		if(limits.maxBytes != std::numeric_limits<uint64_t>::max() && isLongerThan(jsonStream, limits.maxBytes))
+			return rapidjson::ParseResult(kParseErrorDocumentTooBig, 0);
+
+		if(!limits.IsEventLimitSet())
+			return parseStream<parseFlags>(reader, jsonStream, handler, limits.iterative);
+
+		LimitHandler<Handler> limitHandler(handler, limits);
+		rapidjson::ParseResult result = parseStream<parseFlags>(reader, jsonStream, limitHandler, limits.iterative);
+
+		if(limitHandler.GetError() != rapidjson::kParseErrorNone)
+			result.Set(limitHandler.GetError(), result.Offset());
+		return result;
+	}
+
+	/*
+	 * Generator for rapidjson::Document::Populate, parses a stream into the document within the limits.
+	 */
+	template<unsigned parseFlags, typename SourceEncoding, typename Stream>
+	struct DocumentParser {
+
+		DocumentParser(Stream & jsonStream) : jsonStream_(jsonStream) {}
+
+		bool operator()(rapidjson::Document & document) {
+			result = parseWithLimits<parseFlags, SourceEncoding>(jsonStream_, document);
+			return !result.IsError();
+		}
+
+		rapidjson::ParseResult result;
+
+	private:
+		Stream & jsonStream_;
+	};
+
+	template<unsigned parseFlags, typename SourceEncoding, typename Stream>
+	inline rapidjson::ParseResult parseDocument(Stream & jsonStream, rapidjson::Document & document) {
+		DocumentParser<parseFlags, SourceEncoding, Stream> parser(jsonStream);
+		document.Populate(parser);
+		return parser.result;
+	}
+
+}}}}
+
+#endif /* JSON_LIMITS_H_ */
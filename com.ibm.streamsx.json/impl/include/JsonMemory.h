@@ -0,0 +1,68 @@
+/*
+ * JsonMemory.h
+ *
+ * Per thread memory limit for the buffers kept between calls.
+ * Output buffers and loaded tapes keep their capacity to be reused by the next call,
+ * once a buffer has grown beyond the limit it is released instead of being reused,
+ * so a single large document does not pin its memory in every thread.
+ */
+
+#ifndef JSON_MEMORY_H_
+#define JSON_MEMORY_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/stringbuffer.h"
+
+#include <limits>
+#include <vector>
+#include <streams_boost/thread/tss.hpp>
+
+#include <SPL/Runtime/Type/Tuple.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	inline uint64_t & getMemoryLimit() {
+		static streams_boost::thread_specific_ptr<uint64_t> limitPtr_;
+
+		uint64_t * limitPtr = limitPtr_.get();
+		if(!limitPtr) {
+			limitPtr_.reset(new uint64_t(std::numeric_limits<uint64_t>::max()));
+			limitPtr = limitPtr_.get();
+		}
+
+		return *limitPtr;
+	}
+
+	/*
+	 * Sets the memory limit of the calling thread in bytes, 0 releases the buffers after every use.
+	 */
+	inline void setJSONMemoryLimit(uint64_t bytes) {
+		getMemoryLimit() = bytes;
+	}
+
+	inline uint64_t getJSONMemoryLimit() {
+		return getMemoryLimit();
+	}
+
+	/*
+	 * Empties a buffer for reuse, releasing it if its capacity exceeds the limit.
+	 */
+	inline void clearBuffer(rapidjson::StringBuffer & buffer) {
+		buffer.Clear();
+		if(buffer.stack_.GetCapacity() > getMemoryLimit())
+			buffer.ShrinkToFit();
+	}
+
+	/*
+	 * Replaces the content of a buffer, reallocating it to fit if its capacity exceeds the limit.
+	 */
+	inline void assignBuffer(std::vector<char> & buffer, const char* data, size_t size) {
+		if(buffer.capacity() > getMemoryLimit() && buffer.capacity() > size)
+			std::vector<char>(data, data + size).swap(buffer);
+		else
+			buffer.assign(data, data + size);
+	}
+
+}}}}
+
+#endif /* JSON_MEMORY_H_ */
@@ -0,0 +1,246 @@
+/*
+ * JsonNumberFormat.h
+ *
+ * Number formatting for the writer. Integers are converted eight digits at a
+ * time within a 64 bit word (SWAR), floating point values use the Grisu2
+ * implementation of RapidJSON. All functions write finite values to a buffer
+ * which has room for the result plus eight bytes and return the end of the
+ * written text.
+ */
+
+#ifndef JSON_NUMBER_FORMAT_H_
+#define JSON_NUMBER_FORMAT_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/internal/dtoa.h"
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	// upper bounds of the formatted length, without the eight bytes of slack
+	const size_t kMaxInt32Length = 11;
+	const size_t kMaxInt64Length = 20;
+	const size_t kMaxDoubleLength = 25;
+
+	/*
+	 * The eight decimal digits of n < 10^8 with leading zeros, one digit value per
+	 * byte and the most significant digit in the lowest byte. The divisions by 10000,
+	 * 100 and 10 are done for all lanes of the word with one multiplication each.
+	 */
+	inline uint64_t splitDigits8(uint32_t n) {
+		uint64_t x = (n / 10000) | (static_cast<uint64_t>(n % 10000) << 32);
+		uint64_t q = ((x * 10486) >> 20) & 0x0000007F0000007FULL;
+		x = q | ((x - q * 100) << 16);
+		q = ((x * 103) >> 10) & 0x000F000F000F000FULL;
+		return q | ((x - q * 10) << 8);
+	}
+
+	inline void storeDigits8(uint64_t digits, char* out) {
+		digits += 0x3030303030303030ULL;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		digits = __builtin_bswap64(digits);
+#endif
+		std::memcpy(out, &digits, 8);
+	}
+
+	inline char* writeDigits8(uint32_t n, char* out) {
+		storeDigits8(splitDigits8(n), out);
+		return out + 8;
+	}
+
+	inline char* u32toa(uint32_t n, char* out) {
+		if(n < 10) {
+			*out = static_cast<char>('0' + n);
+			return out + 1;
+		}
+		if(n < 100000000) {
+			uint64_t digits = splitDigits8(n);
+			// leading zero digits are the low zero bytes, drop them
+			unsigned leadingZeros = static_cast<unsigned>(__builtin_ctzll(digits)) / 8;
+			storeDigits8(digits >> (leadingZeros * 8), out);
+			return out + 8 - leadingZeros;
+		}
+
+		out = u32toa(n / 100000000, out);
+		return writeDigits8(n % 100000000, out);
+	}
+
+	inline char* u64toa(uint64_t n, char* out) {
+		if(n <= 0xFFFFFFFFULL)
+			return u32toa(static_cast<uint32_t>(n), out);
+
+		out = u64toa(n / 100000000, out);
+		return writeDigits8(static_cast<uint32_t>(n % 100000000), out);
+	}
+
+	inline char* i32toa(int32_t n, char* out) {
+		uint32_t u = static_cast<uint32_t>(n);
+		if(n < 0) {
+			*out++ = '-';
+			u = ~u + 1;
+		}
+		return u32toa(u, out);
+	}
+
+	inline char* i64toa(int64_t n, char* out) {
+		uint64_t u = static_cast<uint64_t>(n);
+		if(n < 0) {
+			*out++ = '-';
+			u = ~u + 1;
+		}
+		return u64toa(u, out);
+	}
+
+	/*
+	 * float64 as the RapidJSON writer formats it, integral values below 2^53
+	 * are written as integer digits followed by ".0" without digit generation.
+	 */
+	inline char* dtoa(double d, char* out, int maxDecimalPlaces) {
+		if(d != 0 && d > -9007199254740992.0 && d < 9007199254740992.0 && d == static_cast<double>(static_cast<int64_t>(d))) {
+			out = i64toa(static_cast<int64_t>(d), out);
+			*out++ = '.';
+			*out++ = '0';
+			return out;
+		}
+		return rapidjson::internal::dtoa(d, out, maxDecimalPlaces);
+	}
+
+	/*
+	 * Grisu2 digit generation for a positive, finite float32. The rounding boundaries
+	 * are those of single precision, so the digits are the shortest which read back
+	 * to the same float32 instead of the digits of the value widened to float64.
+	 */
+	inline char* grisuFloat(float value, char* buffer, int maxDecimalPlaces) {
+		using rapidjson::internal::DiyFp;
+
+		union {
+			float f;
+			uint32_t u32;
+		} u;
+		u.f = value;
+
+		const uint32_t significand = u.u32 & 0x7FFFFF;
+		const int biasedExponent = static_cast<int>((u.u32 >> 23) & 0xFF);
+
+		const DiyFp v = biasedExponent ?
+			DiyFp(significand | 0x800000, biasedExponent - 150) :
+			DiyFp(significand, -149);
+
+		const DiyFp w_p = DiyFp((v.f << 1) + 1, v.e - 1).Normalize();
+		DiyFp w_m = (significand == 0 && biasedExponent > 1) ?
+			DiyFp((v.f << 2) - 1, v.e - 2) :
+			DiyFp((v.f << 1) - 1, v.e - 1);
+		w_m.f <<= w_m.e - w_p.e;
+		w_m.e = w_p.e;
+
+		int length, K;
+		const DiyFp c_mk = rapidjson::internal::GetCachedPower(w_p.e, &K);
+		const DiyFp W = v.Normalize() * c_mk;
+		DiyFp Wp = w_p * c_mk;
+		DiyFp Wm = w_m * c_mk;
+		Wm.f++;
+		Wp.f--;
+		rapidjson::internal::DigitGen(W, Wp, Wp.f - Wm.f, buffer, &length, &K);
+
+		return rapidjson::internal::Prettify(buffer, length, K, maxDecimalPlaces);
+	}
+
+	/*
+	 * float32 with the shortest digits reading back to the same value,
+	 * zero and integral values below 2^24 are written as by dtoa
+	 */
+	inline char* ftoa(float f, char* out, int maxDecimalPlaces) {
+		const float absolute = f < 0 ? -f : f;
+		if(absolute < 16777216.0f && absolute == static_cast<float>(static_cast<int32_t>(absolute)))
+			return dtoa(f, out, maxDecimalPlaces);
+
+		if(f < 0)
+			*out++ = '-';
+		return grisuFloat(absolute, out, maxDecimalPlaces);
+	}
+
+	/*
+	 * Canonical form of a number in JSON number syntax, for decimals which keep
+	 * trailing zeros and exponents as given. Leading and trailing zeros are
+	 * removed and the exponent is used only when plain notation would need more
+	 * than 21 integer digits or more than 5 zeros after the decimal point, as
+	 * ECMAScript formats numbers: "1.50" is "1.5", "1.2E+3" is "1200" and
+	 * "0.0000001" is "1e-7". Zero is "0" whatever its sign.
+	 */
+	inline std::string canonicalNumber(std::string const& str) {
+		const char* p = str.c_str();
+
+		const bool negative = *p == '-';
+		if(negative)
+			p++;
+
+		std::string digits;
+		long exponent = 0;
+		for(; *p >= '0' && *p <= '9'; p++)
+			digits += *p;
+		if(*p == '.') {
+			for(p++; *p >= '0' && *p <= '9'; p++) {
+				digits += *p;
+				exponent--;
+			}
+		}
+		if(*p == 'e' || *p == 'E') {
+			p++;
+			const bool negativeExponent = *p == '-';
+			if(*p == '+' || *p == '-')
+				p++;
+
+			long value = 0;
+			for(; *p >= '0' && *p <= '9' && value < 100000000; p++)
+				value = value * 10 + (*p - '0');
+			exponent += negativeExponent ? -value : value;
+		}
+
+		const size_t first = digits.find_first_not_of('0');
+		if(first == std::string::npos)
+			return "0";
+
+		const size_t last = digits.find_last_not_of('0');
+		exponent += static_cast<long>(digits.size() - 1 - last);
+		digits = digits.substr(first, last + 1 - first);
+
+		// position of the decimal point relative to the first digit
+		const long point = static_cast<long>(digits.size()) + exponent;
+
+		std::string result(negative ? "-" : "");
+		if(exponent >= 0 && point <= 21) {
+			result += digits;
+			result.append(static_cast<size_t>(exponent), '0');
+		}
+		else if(point > 0 && point <= 21) {
+			result += digits.substr(0, static_cast<size_t>(point));
+			result += '.';
+			result += digits.substr(static_cast<size_t>(point));
+		}
+		else if(point <= 0 && point > -6) {
+			result += "0.";
+			result.append(static_cast<size_t>(-point), '0');
+			result += digits;
+		}
+		else {
+			result += digits[0];
+			if(digits.size() > 1) {
+				result += '.';
+				result += digits.substr(1);
+			}
+
+			char buffer[kMaxInt64Length + 8];
+			result += 'e';
+			result += point - 1 < 0 ? '-' : '+';
+			result.append(buffer, i64toa(point - 1 < 0 ? 1 - point : point - 1, buffer));
+		}
+
+		return result;
+	}
+
+}}}}
+
+#endif /* JSON_NUMBER_FORMAT_H_ */
@@ -10,19 +10,31 @@
 
 #define STREAMS_BOOST_LEXICAL_CAST_ASSUME_C_LOCALE
 
+#include "JsonConfig.h"
 #include "rapidjson/error/en.h"
 #include "rapidjson/document.h"
+#include "rapidjson/memorystream.h"
 #include "rapidjson/pointer.h"
 #include "rapidjson/reader.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
-
+#include "JsonBase64.h"
+#include "JsonChunks.h"
+#include "JsonLimits.h"
+#include "JsonMemory.h"
+#include "JsonShared.h"
+#include "JsonTape.h"
+#include "JsonTimeFormat.h"
+
+#include <algorithm>
+#include <set>
 #include <stack>
 #include <streams_boost/lexical_cast.hpp>
 #include <streams_boost/mpl/or.hpp>
 #include <streams_boost/thread/tss.hpp>
 #include <streams_boost/type_traits.hpp>
 #include <streams_boost/utility/enable_if.hpp>
+#include <vector>
 
 #include <SPL/Runtime/Type/Tuple.h>
 
@@ -52,6 +64,89 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		SPL::set<SPL::rstring> foundKeys;
 	};
 
+	inline EpochUnit & getEpochUnit() {
+		static streams_boost::thread_specific_ptr<EpochUnit> unitPtr_;
+
+		EpochUnit * unitPtr = unitPtr_.get();
+		if(!unitPtr) {
+			unitPtr_.reset(new EpochUnit(kEpochAuto));
+			unitPtr = unitPtr_.get();
+		}
+
+		return *unitPtr;
+	}
+
+	/*
+	 * Sets the unit of the epoch numbers read as timestamps by the calling thread,
+	 * kEpochAuto chooses it by magnitude.
+	 */
+	template<class Unit>
+	inline void setJSONEpochUnit(Unit const& unit) {
+		getEpochUnit() = static_cast<EpochUnit>(unit.getIndex());
+	}
+
+	/*
+	 * timestamp of a JSON number read as epoch value in the unit of the calling thread,
+	 * see fromEpoch, false if the number is no valid timestamp
+	 */
+	template<typename T>
+	inline bool numberToTimestamp(T num, SPL::timestamp & ts) {
+		int64_t seconds;
+		uint32_t nanoseconds;
+		fromEpoch(static_cast<int64_t>(num), getEpochUnit(), seconds, nanoseconds);
+
+		ts = SPL::timestamp(seconds, nanoseconds);
+		return true;
+	}
+
+	inline bool numberToTimestamp(double num, SPL::timestamp & ts) {
+		int64_t seconds;
+		uint32_t nanoseconds;
+		if(!fromEpoch(num, getEpochUnit(), seconds, nanoseconds))
+			return false;
+
+		ts = SPL::timestamp(seconds, nanoseconds);
+		return true;
+	}
+
+	/*
+	 * timestamp of a JSON string in ISO-8601 format,
+	 * false if the string is no valid date and time
+	 */
+	inline bool stringToTimestamp(const char* str, size_t length, SPL::timestamp & ts) {
+		int64_t seconds;
+		uint32_t nanoseconds;
+		if(!parseIso8601(str, length, seconds, nanoseconds))
+			return false;
+
+		ts = SPL::timestamp(seconds, nanoseconds);
+		return true;
+	}
+
+	/*
+	 * blob of a JSON string in base64, decoded straight into the blob data,
+	 * false if the string is no valid base64
+	 */
+	inline bool stringToBlob(const char* str, size_t length, SPL::blob & value) {
+		size_t textLength, decodedLength;
+		if(!base64DecodedLength(str, length, textLength, decodedLength))
+			return false;
+
+		if(decodedLength == 0) {
+			value = SPL::blob();
+			return textLength == 0;
+		}
+
+		unsigned char* data = new unsigned char[decodedLength];
+		if(!decodeBase64(str, textLength, data)) {
+			delete[] data;
+			return false;
+		}
+
+		value.adoptData(data, decodedLength);
+		return true;
+	}
+
 
 	/* EventHandler as expected by RapidJSON lib SAX parser
 	 *
@@ -89,7 +184,11 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 	 *
 	 * 	SPL decimal types are not supported.
 	 * 	SPL Set of tuple is not supported.
-	 * 	SPL timestamps are not supported.
+	 * 	SPL timestamps are set from numbers as epoch seconds, milliseconds, microseconds
+	 * 	or nanoseconds (see setJSONEpochUnit, chosen by magnitude by default) and from
+	 * 	ISO-8601 strings. Values which are no valid timestamp are ignored.
+	 * 	SPL blobs are set from base64 strings, other strings are ignored, and from the
+	 * 	byte strings of CBOR and MessagePack.
 	 */
 	struct EventHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, EventHandler> {
 
@@ -284,6 +383,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 							case SPL::Meta::Type::UINT64 : { static_cast<SPL::optional<SPL::uint64> &>(refOptional) = SPL::uint64(num); break; }
 							case SPL::Meta::Type::FLOAT32 : { static_cast<SPL::optional<SPL::float32> &>(refOptional) = SPL::float32(num); break; }
 							case SPL::Meta::Type::FLOAT64 : { static_cast<SPL::optional<SPL::float64> &>(refOptional) = SPL::float64(num); break; }
+							case SPL::Meta::Type::TIMESTAMP : { SPL::timestamp ts; if(numberToTimestamp(num, ts)) static_cast<SPL::optional<SPL::timestamp> &>(refOptional) = ts; break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
@@ -299,6 +399,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 							case SPL::Meta::Type::UINT64 : { static_cast<SPL::uint64&>(valueHandle) = num; break; }
 							case SPL::Meta::Type::FLOAT32 : { static_cast<SPL::float32&>(valueHandle) = num; break; }
 							case SPL::Meta::Type::FLOAT64 : { static_cast<SPL::float64&>(valueHandle) = num; break; }
+							case SPL::Meta::Type::TIMESTAMP : { numberToTimestamp(num, static_cast<SPL::timestamp&>(valueHandle)); break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
@@ -319,6 +420,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 								case SPL::Meta::Type::UINT64 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::uint64>(num))); break; }
 								case SPL::Meta::Type::FLOAT32 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::float32>(num))); break; }
 								case SPL::Meta::Type::FLOAT64 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::float64>(num))); break; }
+								case SPL::Meta::Type::TIMESTAMP : { SPL::timestamp ts; if(numberToTimestamp(num, ts)) InsertValue(valueHandle, SPL::ConstValueHandle(ts)); break; }
 								default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 							}
 						}
@@ -337,6 +439,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 							case SPL::Meta::Type::UINT64 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::uint64>(num))); break; }
 							case SPL::Meta::Type::FLOAT32 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::float32>(num))); break; }
 							case SPL::Meta::Type::FLOAT64 : { InsertValue(valueHandle, SPL::ConstValueHandle(static_cast<SPL::float64>(num))); break; }
+							case SPL::Meta::Type::TIMESTAMP : { SPL::timestamp ts; if(numberToTimestamp(num, ts)) InsertValue(valueHandle, SPL::ConstValueHandle(ts)); break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
@@ -378,14 +481,26 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 							case SPL::Meta::Type::USTRING : {
 								static_cast<SPL::optional<SPL::ustring> &>(refOptional) = SPL::ustring(s,length);
 								break; }
+							case SPL::Meta::Type::TIMESTAMP : {
+								SPL::timestamp ts;
+								if(stringToTimestamp(s, length, ts))
+									static_cast<SPL::optional<SPL::timestamp> &>(refOptional) = ts;
+								break; }
+							case SPL::Meta::Type::BLOB : {
+								SPL::blob b;
+								if(stringToBlob(s, length, b))
+									static_cast<SPL::optional<SPL::blob> &>(refOptional) = b;
+								break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
 					else {
 						switch(valueHandle.getMetaType()) {
 							case SPL::Meta::Type::BSTRING : { static_cast<SPL::BString&>(valueHandle) = SPL::rstring(s, length); break; }
-							case SPL::Meta::Type::RSTRING : { static_cast<SPL::rstring&>(valueHandle) = s; break; }
-							case SPL::Meta::Type::USTRING : { static_cast<SPL::ustring&>(valueHandle) = s; break; }
+							case SPL::Meta::Type::RSTRING : { static_cast<SPL::rstring&>(valueHandle).assign(s, length); break; }
+							case SPL::Meta::Type::USTRING : { static_cast<SPL::ustring&>(valueHandle) = SPL::ustring(s, length); break; }
+							case SPL::Meta::Type::TIMESTAMP : { stringToTimestamp(s, length, static_cast<SPL::timestamp&>(valueHandle)); break; }
+							case SPL::Meta::Type::BLOB : { stringToBlob(s, length, static_cast<SPL::blob&>(valueHandle)); break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
@@ -399,6 +514,8 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 								case SPL::Meta::Type::BSTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::bstring<1024>(s, length))); break; }
 								case SPL::Meta::Type::RSTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::rstring(s, length))); break; }
 								case SPL::Meta::Type::USTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::ustring(s, length))); break; }
+								case SPL::Meta::Type::TIMESTAMP : { SPL::timestamp ts; if(stringToTimestamp(s, length, ts)) InsertValue(valueHandle, SPL::ConstValueHandle(ts)); break; }
+								case SPL::Meta::Type::BLOB : { SPL::blob b; if(stringToBlob(s, length, b)) InsertValue(valueHandle, SPL::ConstValueHandle(b)); break; }
 								default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 							}
 
@@ -411,6 +528,8 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 							case SPL::Meta::Type::BSTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::bstring<1024>(s, length))); break; }
 							case SPL::Meta::Type::RSTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::rstring(s, length))); break; }
 							case SPL::Meta::Type::USTRING : { InsertValue(valueHandle, SPL::ConstValueHandle(SPL::ustring(s, length))); break; }
+							case SPL::Meta::Type::TIMESTAMP : { SPL::timestamp ts; if(stringToTimestamp(s, length, ts)) InsertValue(valueHandle, SPL::ConstValueHandle(ts)); break; }
+							case SPL::Meta::Type::BLOB : { SPL::blob b; if(stringToBlob(s, length, b)) InsertValue(valueHandle, SPL::ConstValueHandle(b)); break; }
 							default : SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
 						}
 					}
@@ -420,6 +539,65 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 			return true;
 		}
 
+		/*
+		 * Byte string of a binary encoding, blobs take the bytes as they are.
+		 * Strings get the bytes in base64, all other values ignore them.
+		 */
+		bool Bytes(const unsigned char* data, size_t length) {
+			TupleState & state = objectStack.top();
+
+			if(state.attrIter == state.tuple.getEndIterator()) {
+				SPLAPPTRC(L_DEBUG, "not matched, dropped bytes", "EXTRACT_FROM_JSON");
+				return true;
+			}
+
+			SPL::ValueHandle valueHandle = (*state.attrIter).getValue();
+			const bool isOptional = valueHandle.getMetaType() == SPL::Meta::Type::OPTIONAL;
+
+			SPL::Meta::Type targetType = valueHandle.getMetaType();
+			if(state.inCollection != NO)
+				targetType = valueType;
+			else if(isOptional)
+				targetType = static_cast<SPL::Optional &>(valueHandle).getValueMetaType();
+
+			switch(targetType) {
+				case SPL::Meta::Type::BSTRING :
+				case SPL::Meta::Type::RSTRING :
+				case SPL::Meta::Type::USTRING : {
+					bytesText.resize(base64EncodedLength(length));
+					if(!bytesText.empty())
+						encodeBase64(data, length, &bytesText[0]);
+					return String(bytesText.c_str(), static_cast<rapidjson::SizeType>(bytesText.size()), true);
+				}
+				case SPL::Meta::Type::BLOB : break;
+				default :
+					SPLAPPTRC(L_DEBUG, "not matched", "EXTRACT_FROM_JSON");
+					return true;
+			}
+
+			SPLAPPTRC(L_DEBUG, "extracted bytes: " << length, "EXTRACT_FROM_JSON");
+
+			if(state.inCollection == NO) {
+				if(isOptional)
+					static_cast<SPL::optional<SPL::blob> &>(valueHandle) = SPL::blob(data, length);
+				else
+					static_cast<SPL::blob &>(valueHandle).setData(data, length);
+			}
+			else {
+				if(isOptional) {
+					SPL::Optional & refOptional = static_cast<SPL::Optional &>(valueHandle);
+					if(!refOptional.isPresent()) {
+						SPLAPPTRC(L_DEBUG, "not matched, optional is not present", "EXTRACT_FROM_JSON");
+						return true;
+					}
+					valueHandle = refOptional.getValue();
+				}
+				InsertValue(valueHandle, SPL::ConstValueHandle(SPL::blob(data, length)));
+			}
+
+			return true;
+		}
+
 		bool StartObject() {
 			SPLAPPTRC(L_DEBUG, "object started", "EXTRACT_FROM_JSON");
 
@@ -979,21 +1157,167 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		bool valueIsOptional;
 		// store the stack of nested tuples, the top is the one which is open/in-work
 		std::stack<TupleState> objectStack;
+		// base64 text of a byte string read into a string attribute
+		std::string bytesText;
 	};
 
-	inline SPL::Tuple& extractFromJSON(SPL::rstring const& jsonString, SPL::Tuple & tuple) {
+	/*
+	 * Build a stream over a sub range of a string, offset and length are given in bytes.
+	 * The range is read with known length, so neither a NUL terminator nor a copy is needed.
+	 */
+	inline rapidjson::MemoryStream getMemoryStream(SPL::rstring const& jsonString, uint32_t offset, uint32_t length) {
+		if(offset > jsonString.size() || length > jsonString.size() - offset)
+			THROW(SPL::SPLRuntimeInvalidArgument, "Invalid range [" << offset << "," << offset + (uint64_t)length << ") for JSON string of size " << jsonString.size());
+
+		return rapidjson::MemoryStream(jsonString.data() + offset, length);
+	}
+
+	inline rapidjson::MemoryStream getMemoryStream(SPL::blob const& jsonBlob) {
+		return rapidjson::MemoryStream(reinterpret_cast<const char*>(jsonBlob.getData()), jsonBlob.getSize());
+	}
+
+	/*
+	 * Read only stream over the UTF-16 buffer of a ustring, read with known length
+	 * as rapidjson::MemoryStream does for bytes.
+	 */
+	struct UTF16MemoryStream {
+		typedef UChar Ch;
+
+		UTF16MemoryStream(const Ch* src, size_t size) : src_(src), begin_(src), end_(src + size) {}
+
+		Ch Peek() const { return src_ == end_ ? Ch('\0') : *src_; }
+		Ch Take() { return src_ == end_ ? Ch('\0') : *src_++; }
+		size_t Tell() const { return static_cast<size_t>(src_ - begin_); }
+
+		Ch* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		void Put(Ch) { RAPIDJSON_ASSERT(false); }
+		void Flush() { RAPIDJSON_ASSERT(false); }
+		size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+		const Ch* src_;
+		const Ch* begin_;
+		const Ch* end_;
+	};
+
+	inline bool isLongerThan(UTF16MemoryStream const& jsonStream, uint64_t bytes) {
+		return static_cast<uint64_t>(jsonStream.end_ - jsonStream.src_) * sizeof(UTF16MemoryStream::Ch) > bytes;
+	}
 
-	    EventHandler handler(tuple);
-	    rapidjson::Reader reader;
-	    rapidjson::StringStream jsonStringStream(jsonString.c_str());
-	    reader.Parse(jsonStringStream, handler);
+	/*
+	 * Source encoding of a stream as given by its character type,
+	 * UTF-16 input is transcoded to UTF-8 while parsing.
+	 */
+	template<typename Ch>
+	struct SourceEncoding { typedef rapidjson::UTF16<Ch> Type; };
+
+	template<>
+	struct SourceEncoding<char> { typedef rapidjson::UTF8<> Type; };
+
+	inline UTF16MemoryStream getMemoryStream(SPL::ustring const& jsonString) {
+		return UTF16MemoryStream(jsonString.getBuffer(), jsonString.length());
+	}
+
+	template<typename Stream>
+	inline SPL::Tuple& extractFromJSONStream(Stream & jsonStream, SPL::Tuple & tuple) {
+
+		EventHandler handler(tuple);
+		const rapidjson::ParseResult result = parseWithLimits<rapidjson::kParseDefaultFlags, typename SourceEncoding<typename Stream::Ch>::Type>(jsonStream, handler);
+		if(result.Code() > rapidjson::kParseErrorUnspecificSyntaxError) {
+			SPLAPPTRC(L_ERROR, getParseErrorString(result.Code()), "EXTRACT_FROM_JSON");
+		}
 
 		return tuple;
 	}
 
+	inline SPL::Tuple& extractFromJSON(SPL::rstring const& jsonString, SPL::Tuple & tuple) {
+
+		rapidjson::StringStream jsonStringStream(jsonString.c_str());
+		return extractFromJSONStream(jsonStringStream, tuple);
+	}
+
+	inline SPL::Tuple& extractFromJSON(SPL::blob const& jsonBlob, SPL::Tuple & tuple) {
+
+		rapidjson::MemoryStream jsonStream = getMemoryStream(jsonBlob);
+		return extractFromJSONStream(jsonStream, tuple);
+	}
+
+	inline SPL::Tuple& extractFromJSON(SPL::rstring const& jsonString, uint32_t offset, uint32_t length, SPL::Tuple & tuple) {
+
+		rapidjson::MemoryStream jsonStream = getMemoryStream(jsonString, offset, length);
+		return extractFromJSONStream(jsonStream, tuple);
+	}
+
+	inline SPL::Tuple& extractFromJSON(SPL::ustring const& jsonString, SPL::Tuple & tuple) {
+
+		UTF16MemoryStream jsonStream = getMemoryStream(jsonString);
+		return extractFromJSONStream(jsonStream, tuple);
+	}
 
+	/*
+	 * Reads column oriented JSON, one object holding an array per attribute as written
+	 * by tuplesToJSON with JsonBatchFormat.format.COLUMNS, into a list of tuples.
+	 * The rows are created at once for the longest column, then each row is read by
+	 * the EventHandler as if it were an object of its cells, so the values are mapped
+	 * as by extractFromJSON. Members which are no arrays, match no attribute or
+	 * repeat a column are ignored.
+	 */
 	template<typename T>
-	inline T parseNumber(rapidjson::Value * value) {
+	inline SPL::list<T>& extractColumnsFromJSON(SPL::rstring const& jsonString, SPL::list<T> & tuples) {
+
+		tuples.clear();
+
+		rapidjson::Document document;
+		rapidjson::StringStream jsonStream(jsonString.c_str());
+		if(parseDocument<rapidjson::kParseDefaultFlags, rapidjson::UTF8<> >(jsonStream, document).IsError() || !document.IsObject()) {
+			SPLAPPTRC(L_DEBUG, "no JSON object of columns", "EXTRACT_FROM_JSON");
+			return tuples;
+		}
+
+		const T prototype;
+		std::vector<rapidjson::Value::ConstMemberIterator> columns;
+		std::set<std::string> names;
+		rapidjson::SizeType rows = 0;
+
+		for(rapidjson::Value::ConstMemberIterator it = document.MemberBegin(); it != document.MemberEnd(); ++it) {
+			const std::string name(it->name.GetString(), it->name.GetStringLength());
+
+			if(!it->value.IsArray() || prototype.findAttribute(name) == prototype.getEndIterator() || !names.insert(name).second) {
+				SPLAPPTRC(L_DEBUG, "not matched, dropped column: " << name, "EXTRACT_FROM_JSON");
+				continue;
+			}
+
+			columns.push_back(it);
+			if(it->value.Size() > rows)
+				rows = it->value.Size();
+		}
+
+		tuples.resize(rows);
+
+		for(rapidjson::SizeType row = 0; row < rows; row++) {
+			EventHandler handler(tuples[row]);
+			handler.StartObject();
+
+			for(size_t i = 0; i < columns.size(); i++) {
+				rapidjson::Value const& column = columns[i]->value;
+				if(row >= column.Size())
+					continue;
+
+				handler.Key(columns[i]->name.GetString(), columns[i]->name.GetStringLength(), false);
+				column[row].Accept(handler);
+			}
+
+			handler.EndObject(0);
+		}
+
+		return tuples;
+	}
+
+
+	/*
+	 * The getJSONValue functions read rapidjson::Value as well as TapeValue of a loaded tape
+	 */
+	template<typename T, typename JsonValue>
+	inline T parseNumber(JsonValue * value) {
 		rapidjson::StringBuffer str;
 		rapidjson::Writer<rapidjson::StringBuffer> writer(str);
 		value->Accept(writer);
@@ -1002,11 +1326,11 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 
 	template<typename Status>
 	inline SPL::rstring getParseError(Status const& status) {
-		return GetParseError_En((rapidjson::ParseErrorCode)status.getIndex());
+		return getParseErrorString((rapidjson::ParseErrorCode)status.getIndex());
 	}
 
-	template<typename Status, typename Index>
-	inline SPL::boolean getJSONValue(rapidjson::Value * value, SPL::boolean defaultVal, Status & status, Index const& jsonIndex) {
+	template<typename JsonValue, typename Status, typename Index>
+	inline SPL::boolean getJSONValue(JsonValue * value, SPL::boolean defaultVal, Status & status, Index const& jsonIndex) {
 
 		if(!value)					status = 4;
 		else if(value->IsNull())	status = 3;
@@ -1023,8 +1347,8 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		return defaultVal;
 	}
 
-	template<typename T, typename Status, typename Index>
-	inline T getJSONValue(rapidjson::Value * value, T defaultVal, Status & status, Index const& jsonIndex,
+	template<typename JsonValue, typename T, typename Status, typename Index>
+	inline T getJSONValue(JsonValue * value, T defaultVal, Status & status, Index const& jsonIndex,
 					   typename streams_boost::enable_if< typename streams_boost::mpl::or_<
 					   	   streams_boost::mpl::bool_< streams_boost::is_arithmetic<T>::value>,
 						   streams_boost::mpl::bool_< streams_boost::is_same<SPL::decimal32, T>::value>,
@@ -1069,8 +1393,8 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		return defaultVal;
 	}
 
-	template<typename T, typename Status, typename Index>
-	inline T getJSONValue(rapidjson::Value * value, T const& defaultVal, Status & status, Index const& jsonIndex,
+	template<typename JsonValue, typename T, typename Status, typename Index>
+	inline T getJSONValue(JsonValue * value, T const& defaultVal, Status & status, Index const& jsonIndex,
 					   typename streams_boost::enable_if< typename streams_boost::mpl::or_<
 					   	   streams_boost::mpl::bool_< streams_boost::is_base_of<SPL::RString, T>::value>,
 						   streams_boost::mpl::bool_< streams_boost::is_same<SPL::ustring, T>::value>
@@ -1110,8 +1434,42 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		return defaultVal;
 	}
 
-	template<typename T, typename Status, typename Index>
-	inline SPL::list<T> getJSONValue(rapidjson::Value * value, SPL::list<T> const& defaultVal, Status & status, Index const& jsonIndex) {
+	/*
+	 * timestamps are read from numbers as epoch values and from ISO-8601 strings
+	 */
+	template<typename JsonValue, typename Status, typename Index>
+	inline SPL::timestamp getJSONValue(JsonValue * value, SPL::timestamp const& defaultVal, Status & status, Index const& jsonIndex) {
+
+		SPL::timestamp ts;
+
+		if(!value)					status = 4;
+		else if(value->IsNull())	status = 3;
+		else if(value->IsInt64() && numberToTimestamp(value->GetInt64(), ts))	{ status = 0; return ts; }
+		else if(value->IsNumber() && numberToTimestamp(value->GetDouble(), ts))	{ status = 0; return ts; }
+		else if(value->IsString() && stringToTimestamp(value->GetString(), value->GetStringLength(), ts))	{ status = 0; return ts; }
+		else						status = 2;
+
+		return defaultVal;
+	}
+
+	/*
+	 * blobs are read from base64 strings
+	 */
+	template<typename JsonValue, typename Status, typename Index>
+	inline SPL::blob getJSONValue(JsonValue * value, SPL::blob const& defaultVal, Status & status, Index const& jsonIndex) {
+
+		SPL::blob result;
+
+		if(!value)					status = 4;
+		else if(value->IsNull())	status = 3;
+		else if(value->IsString() && stringToBlob(value->GetString(), value->GetStringLength(), result))	{ status = 0; return result; }
+		else						status = 2;
+
+		return defaultVal;
+	}
+
+	template<typename JsonValue, typename T, typename Status, typename Index>
+	inline SPL::list<T> getJSONValue(JsonValue * value, SPL::list<T> const& defaultVal, Status & status, Index const& jsonIndex) {
 
 		if(!value)					status = 4;
 		else if(value->IsNull())	status = 3;
@@ -1119,13 +1477,12 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		else						status = 0;
 
 		if(status == 0) {
-			rapidjson::Value::Array arr = value->GetArray();
 			SPL::list<T> result;
-			result.reserve(arr.Size());
+			result.reserve(value->Size());
 			Status valueStatus = 0;
 
-			for (rapidjson::Value::Array::ValueIterator it = arr.Begin(); it != arr.End(); ++it) {
-				T val = getJSONValue(it, T(), valueStatus, jsonIndex);
+			for (typename JsonValue::ConstValueIterator it = value->Begin(); it != value->End(); ++it) {
+				T val = getJSONValue(&*it, T(), valueStatus, jsonIndex);
 
 				if(valueStatus == 0)
 					result.push_back(val);
@@ -1159,44 +1516,362 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 			return *jsonPtr;
 		}
 
-		template<typename Status, typename Index>
-		inline bool parseJSON(SPL::rstring const& jsonString, Status & status, uint32_t & offset, const Index & jsonIndex) {
+		/*
+		 * tape loaded by loadJSON or shared document attached by attachJSON,
+		 * it replaces the parsed document of the index until the next parseJSON
+		 */
+		struct IndexSlot {
+			IndexSlot() : peak(0) {}
+
+			std::vector<char> data;
+			TapeView view;
+			SharedDocument shared;
+			uint64_t peak;
+		};
+
+		template<typename Index>
+		inline IndexSlot& getIndexSlot() {
+			static streams_boost::thread_specific_ptr<IndexSlot> slotPtr_;
+
+			IndexSlot * slotPtr = slotPtr_.get();
+			if(!slotPtr) {
+				slotPtr_.reset(new IndexSlot());
+				slotPtr = slotPtr_.get();
+			}
+
+			return *slotPtr;
+		}
+
+		/*
+		 * Bytes held by the index, the memory pool of the parsed document and the copy of a loaded tape.
+		 * A shared document attached by attachJSON is not owned by the index and is not counted.
+		 */
+		template<typename Index>
+		inline uint64_t getJSONMemoryUsage(const Index & jsonIndex) {
+			return getDocument<Index>().GetAllocator().Capacity() + getIndexSlot<Index>().data.capacity();
+		}
+
+		template<typename Index>
+		inline void updateJSONMemoryPeak(const Index & jsonIndex) {
+			IndexSlot & slot = getIndexSlot<Index>();
+			slot.peak = std::max(slot.peak, getJSONMemoryUsage(jsonIndex));
+		}
+
+		template<typename Index>
+		inline uint64_t getJSONPeakMemoryUsage(const Index & jsonIndex) {
+			return getIndexSlot<Index>().peak;
+		}
+
+		/*
+		 * Frees the document, tape or shared document held by the index and returns the bytes released,
+		 * queryJSON can be used again after the next parseJSON, loadJSON or attachJSON.
+		 */
+		template<typename Index>
+		inline uint64_t releaseJSON(const Index & jsonIndex) {
+			const uint64_t released = getJSONMemoryUsage(jsonIndex);
+
+			IndexSlot & slot = getIndexSlot<Index>();
+			slot.view = TapeView();
+			slot.shared.reset();
+			std::vector<char>().swap(slot.data);
+			rapidjson::Document().Swap(getDocument<Index>());
+
+			return released;
+		}
+
+		template<typename Stream, typename Status, typename Index>
+		inline bool parseJSONStream(Stream & jsonStream, Status & status, uint32_t & offset, const Index & jsonIndex) {
+			IndexSlot & slot = getIndexSlot<Index>();
+			slot.view = TapeView();
+			slot.shared.reset();
+			assignBuffer(slot.data, 0, 0);
+
 			rapidjson::Document & json = getDocument<Index>();
 			rapidjson::Document(rapidjson::kObjectType).Swap(json);
 
-			if(json.Parse<rapidjson::kParseStopWhenDoneFlag>(jsonString.c_str()).HasParseError()) {
+			const rapidjson::ParseResult result = parseDocument<rapidjson::kParseStopWhenDoneFlag, typename SourceEncoding<typename Stream::Ch>::Type>(jsonStream, json);
+			updateJSONMemoryPeak(jsonIndex);
+
+			if(result.IsError()) {
 				json.SetObject();
-				status = json.GetParseError();
-				offset = json.GetErrorOffset();
+				status = result.Code();
+				offset = result.Offset();
 
 				return false;
 			}
 			return true;
 		}
 
+		template<typename Stream, typename Index>
+		inline uint32_t parseJSONStream(Stream & jsonStream, const Index & jsonIndex) {
+
+			rapidjson::ParseErrorCode status = rapidjson::kParseErrorNone;
+			uint32_t offset = 0;
+
+			if(!parseJSONStream(jsonStream, status, offset, jsonIndex))
+				SPLAPPTRC(L_ERROR, getParseErrorString(status), "PARSE_JSON");
+
+			return (uint32_t)status;
+		}
+
+		template<typename Status, typename Index>
+		inline bool parseJSON(SPL::rstring const& jsonString, Status & status, uint32_t & offset, const Index & jsonIndex) {
+			rapidjson::StringStream jsonStream(jsonString.c_str());
+			return parseJSONStream(jsonStream, status, offset, jsonIndex);
+		}
+
 		template<typename Index>
 		inline uint32_t  parseJSON(SPL::rstring const& jsonString, const Index & jsonIndex) {
+			rapidjson::StringStream jsonStream(jsonString.c_str());
+			return parseJSONStream(jsonStream, jsonIndex);
+		}
+
+		/*
+		 * parseJSON for blob input and for a byte range of a string (parseJSONRange),
+		 * the input is parsed in place with known length.
+		 * The error offset is relative to the start of the parsed range.
+		 */
+		template<typename Status, typename Index>
+		inline bool parseJSON(SPL::blob const& jsonBlob, Status & status, uint32_t & offset, const Index & jsonIndex) {
+			rapidjson::MemoryStream jsonStream = getMemoryStream(jsonBlob);
+			return parseJSONStream(jsonStream, status, offset, jsonIndex);
+		}
+
+		template<typename Index>
+		inline uint32_t parseJSON(SPL::blob const& jsonBlob, const Index & jsonIndex) {
+			rapidjson::MemoryStream jsonStream = getMemoryStream(jsonBlob);
+			return parseJSONStream(jsonStream, jsonIndex);
+		}
+
+		/*
+		 * parseJSON for ustring input, the UTF-16 text is transcoded while parsing.
+		 * The error offset is given in UTF-16 code units.
+		 */
+		template<typename Status, typename Index>
+		inline bool parseJSON(SPL::ustring const& jsonString, Status & status, uint32_t & offset, const Index & jsonIndex) {
+			UTF16MemoryStream jsonStream = getMemoryStream(jsonString);
+			return parseJSONStream(jsonStream, status, offset, jsonIndex);
+		}
+
+		template<typename Index>
+		inline uint32_t parseJSON(SPL::ustring const& jsonString, const Index & jsonIndex) {
+			UTF16MemoryStream jsonStream = getMemoryStream(jsonString);
+			return parseJSONStream(jsonStream, jsonIndex);
+		}
+
+		template<typename Status, typename Index>
+		inline bool parseJSONRange(SPL::rstring const& jsonString, uint32_t rangeOffset, uint32_t rangeLength, Status & status, uint32_t & offset, const Index & jsonIndex) {
+			rapidjson::MemoryStream jsonStream = getMemoryStream(jsonString, rangeOffset, rangeLength);
+			return parseJSONStream(jsonStream, status, offset, jsonIndex);
+		}
+
+		template<typename Index>
+		inline uint32_t parseJSONRange(SPL::rstring const& jsonString, uint32_t rangeOffset, uint32_t rangeLength, const Index & jsonIndex) {
+			rapidjson::MemoryStream jsonStream = getMemoryStream(jsonString, rangeOffset, rangeLength);
+			return parseJSONStream(jsonStream, jsonIndex);
+		}
+
+		/*
+		 * Stream of JSON documents received in chunks, each index has its own stream
+		 * and the documents taken from it are parsed into the index.
+		 */
+		template<typename Index>
+		inline ChunkScanner& getChunkScanner() {
+			static streams_boost::thread_specific_ptr<ChunkScanner> scannerPtr_;
+
+			ChunkScanner * scannerPtr = scannerPtr_.get();
+			if(!scannerPtr) {
+				scannerPtr_.reset(new ChunkScanner());
+				scannerPtr = scannerPtr_.get();
+			}
+
+			return *scannerPtr;
+		}
+
+		template<typename Index>
+		inline void feedJSON(SPL::rstring const& chunk, const Index & jsonIndex) {
+			getChunkScanner<Index>().Feed(chunk.data(), chunk.size(), getParseLimits().maxBytes);
+		}
+
+		template<typename Index>
+		inline void feedJSON(SPL::blob const& chunk, const Index & jsonIndex) {
+			getChunkScanner<Index>().Feed(reinterpret_cast<const char*>(chunk.getData()), chunk.getSize(), getParseLimits().maxBytes);
+		}
+
+		/*
+		 * Parses the next completed document of the stream into the index, returns false if no
+		 * document is complete yet. The status tells whether it was parsed, the error offset is
+		 * relative to the document.
+		 */
+		template<typename Status, typename Index>
+		inline SPL::boolean parseNextJSON(Status & status, uint32_t & offset, const Index & jsonIndex) {
+			ChunkScanner & scanner = getChunkScanner<Index>();
+
+			ChunkScanner::Document document;
+			if(!scanner.Next(document))
+				return false;
+
+			if(document.error != rapidjson::kParseErrorNone) {
+				IndexSlot & slot = getIndexSlot<Index>();
+				slot.view = TapeView();
+				slot.shared.reset();
+				rapidjson::Document(rapidjson::kObjectType).Swap(getDocument<Index>());
+
+				status = document.error;
+				offset = 0;
+				return true;
+			}
+
+			status = rapidjson::kParseErrorNone;
+			offset = 0;
+
+			rapidjson::MemoryStream jsonStream(scanner.Data() + document.begin, document.end - document.begin);
+			parseJSONStream(jsonStream, status, offset, jsonIndex);
+			return true;
+		}
 
+		/*
+		 * Parses the next completed document of the stream into the index, documents
+		 * which cannot be parsed are skipped. Returns false if no document is complete yet.
+		 */
+		template<typename Index>
+		inline SPL::boolean parseNextJSON(const Index & jsonIndex) {
 			rapidjson::ParseErrorCode status = rapidjson::kParseErrorNone;
 			uint32_t offset = 0;
 
-			if(!parseJSON(jsonString, status, offset, jsonIndex))
-				SPLAPPTRC(L_ERROR, GetParseError_En(status), "PARSE_JSON");
+			while(parseNextJSON(status, offset, jsonIndex)) {
+				if(status == rapidjson::kParseErrorNone)
+					return true;
+				SPLAPPTRC(L_ERROR, getParseErrorString(status), "PARSE_JSON");
+			}
+			return false;
+		}
 
-			return (uint32_t)status;
+		/*
+		 * Takes the text of the next completed document of the stream, documents exceeding the size limit are skipped.
+		 */
+		template<typename Index>
+		inline SPL::boolean nextJSON(SPL::rstring & jsonString, const Index & jsonIndex) {
+			ChunkScanner & scanner = getChunkScanner<Index>();
+
+			ChunkScanner::Document document;
+			while(scanner.Next(document)) {
+				if(document.error == rapidjson::kParseErrorNone) {
+					jsonString.assign(scanner.Data() + document.begin, document.end - document.begin);
+					return true;
+				}
+				SPLAPPTRC(L_ERROR, getParseErrorString(document.error), "PARSE_JSON");
+			}
+			return false;
+		}
+
+		/*
+		 * Drops the buffered bytes and the completed documents of the stream.
+		 */
+		template<typename Index>
+		inline void resetJSONStream(const Index & jsonIndex) {
+			getChunkScanner<Index>().Reset();
+		}
+
+		/*
+		 * Attaches a tape written by parseJSONToBlob to the index, queryJSON then reads it in place.
+		 * The tape is copied, it is not parsed or validated beyond its header.
+		 */
+		template<typename Index>
+		inline SPL::boolean loadJSON(SPL::blob const& tape, const Index & jsonIndex) {
+			IndexSlot & slot = getIndexSlot<Index>();
+			const char* data = reinterpret_cast<const char*>(tape.getData());
+
+			slot.view = TapeView();
+			slot.shared.reset();
+			if(!TapeView().Attach(data, tape.getSize())) {
+				SPLAPPTRC(L_ERROR, "blob holds no JSON tape", "PARSE_JSON");
+				return false;
+			}
+
+			assignBuffer(slot.data, data, tape.getSize());
+			slot.view.Attach(&slot.data[0], slot.data.size());
+
+			// release the previously parsed document
+			rapidjson::Document(rapidjson::kObjectType).Swap(getDocument<Index>());
+			updateJSONMemoryPeak(jsonIndex);
+			return true;
+		}
+
+		/*
+		 * Moves the document of the index into a shared document and returns its handle,
+		 * the index stays attached to it. An index attached to a shared document shares it again.
+		 */
+		template<typename Index>
+		inline uint64_t shareJSON(uint32_t references, const Index & jsonIndex) {
+			if(references == 0)
+				THROW(SPL::SPLRuntimeInvalidArgument, "Invalid usage of 'shareJSON' function, at least one reference is required.");
+
+			IndexSlot & slot = getIndexSlot<Index>();
+			rapidjson::Document & json = getDocument<Index>();
+			if(slot.view.IsAttached())
+				THROW(SPL::SPLRuntimeOperator, "Invalid usage of 'shareJSON' function, a tape loaded by 'loadJSON' function cannot be shared.");
+
+			if(!slot.shared) {
+				if(json.IsNull())
+					THROW(SPL::SPLRuntimeOperator, "Invalid usage of 'shareJSON' function, 'parseJSON' function must be used before.");
+
+				rapidjson::Document * document = new rapidjson::Document();
+				document->Swap(json);
+				slot.shared.reset(document);
+				json.SetObject();
+			}
+
+			return getSharedDocuments().add(slot.shared, references);
+		}
+
+		template<typename Index>
+		inline uint64_t shareJSON(const Index & jsonIndex) {
+			return shareJSON(1, jsonIndex);
+		}
+
+		/*
+		 * Attaches the shared document of a handle to the index, it is queried in place and not copied.
+		 * Returns false if the handle is unknown or was released.
+		 */
+		template<typename Index>
+		inline SPL::boolean attachJSON(uint64_t handle, const Index & jsonIndex) {
+			IndexSlot & slot = getIndexSlot<Index>();
+
+			slot.view = TapeView();
+			assignBuffer(slot.data, 0, 0);
+			slot.shared = getSharedDocuments().get(handle);
+			if(!slot.shared) {
+				SPLAPPTRC(L_ERROR, "unknown shared JSON handle " << handle, "PARSE_JSON");
+				return false;
+			}
+
+			// release the previously parsed document
+			rapidjson::Document(rapidjson::kObjectType).Swap(getDocument<Index>());
+			return true;
 		}
 
 		template<typename T, typename Status, typename Index>
 		inline T queryJSON(SPL::rstring const& jsonPath, T const& defaultVal, Status & status, Index const& jsonIndex) {
 
+			IndexSlot const& slot = getIndexSlot<Index>();
 			rapidjson::Document & json = getDocument<Index>();
-			if(json.IsNull())
+			if(json.IsNull() && !slot.view.IsAttached() && !slot.shared)
 				THROW(SPL::SPLRuntimeOperator, "Invalid usage of 'queryJSON' function, 'parseJSON' function must be used before.");
 
 			const rapidjson::Pointer & pointer = rapidjson::Pointer(jsonPath.c_str());
 			rapidjson::PointerParseErrorCode ec = pointer.GetParseErrorCode();
 
-			if(pointer.IsValid()) {
+			if(pointer.IsValid() && slot.view.IsAttached()) {
+				TapeValue value;
+				const bool found = TapeValue(&slot.view, 0).Get(pointer, value);
+				return getJSONValue(found ? &value : 0, defaultVal, status, jsonIndex);
+			}
+			else if(pointer.IsValid() && slot.shared) {
+				const rapidjson::Value * value = pointer.Get(*slot.shared);
+				return getJSONValue(value, defaultVal, status, jsonIndex);
+			}
+			else if(pointer.IsValid()) {
 				rapidjson::Value * value = pointer.Get(json);
 				return getJSONValue(value, defaultVal, status, jsonIndex);
 			}
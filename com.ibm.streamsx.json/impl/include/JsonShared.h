@@ -0,0 +1,98 @@
+/*
+ * JsonShared.h
+ *
+ * Parsed documents shared by the operators and threads of a PE.
+ * shareJSON moves the document of a JsonIndex into an immutable shared document and
+ * returns a handle for it, which can be sent in a uint64 attribute to fused operators.
+ * attachJSON makes the document of a handle the document of a JsonIndex, it is then
+ * queried with queryJSON from any thread without locking, as it is never modified.
+ *
+ * A handle is released by unshareJSON once for each reference it was created with.
+ * Indexes still attached to the document keep it alive, it is freed when the last
+ * of them is parsed into again, so releasing never invalidates a running query.
+ */
+
+#ifndef JSON_SHARED_H_
+#define JSON_SHARED_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/document.h"
+
+#include <map>
+#include <streams_boost/shared_ptr.hpp>
+#include <streams_boost/thread/mutex.hpp>
+
+#include <SPL/Runtime/Type/Tuple.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	typedef streams_boost::shared_ptr<const rapidjson::Document> SharedDocument;
+
+	/*
+	 * Handles are numbered from 1 and never reused, so a stale handle is not found
+	 * instead of referring to another document. The registry is locked only to add,
+	 * look up or release a handle.
+	 */
+	class SharedDocumentRegistry {
+	public:
+		SharedDocumentRegistry() : next_(1) {}
+
+		uint64_t add(SharedDocument const& document, uint32_t references) {
+			streams_boost::mutex::scoped_lock lock(mutex_);
+
+			Entry & entry = documents_[next_];
+			entry.document = document;
+			entry.references = references;
+			return next_++;
+		}
+
+		SharedDocument get(uint64_t handle) const {
+			streams_boost::mutex::scoped_lock lock(mutex_);
+
+			Documents::const_iterator it = documents_.find(handle);
+			return it != documents_.end() ? it->second.document : SharedDocument();
+		}
+
+		bool release(uint64_t handle) {
+			SharedDocument document; // destroyed after unlocking, if it was the last reference
+			streams_boost::mutex::scoped_lock lock(mutex_);
+
+			Documents::iterator it = documents_.find(handle);
+			if(it == documents_.end())
+				return false;
+
+			if(--it->second.references == 0) {
+				document.swap(it->second.document);
+				documents_.erase(it);
+			}
+			return true;
+		}
+
+	private:
+		struct Entry {
+			SharedDocument document;
+			uint32_t references;
+		};
+		typedef std::map<uint64_t, Entry> Documents;
+
+		mutable streams_boost::mutex mutex_;
+		Documents documents_;
+		uint64_t next_;
+	};
+
+	inline SharedDocumentRegistry& getSharedDocuments() {
+		static SharedDocumentRegistry registry;
+		return registry;
+	}
+
+	/*
+	 * Releases one reference of a handle created by shareJSON.
+	 * Returns false if the handle is unknown or was already released.
+	 */
+	inline SPL::boolean unshareJSON(uint64_t handle) {
+		return getSharedDocuments().release(handle);
+	}
+
+}}}}
+
+#endif /* JSON_SHARED_H_ */
@@ -0,0 +1,139 @@
+/*
+ * JsonStringScan.h
+ *
+ * String scanning kernels used by the writer to find the next character of a
+ * UTF-8 string that needs escaping in JSON (control characters, '"' and '\').
+ * SSE2, SSE4.2 and AVX2 variants are compiled side by side, the one used is
+ * chosen once at run time from the CPU features, so a single toolkit build
+ * runs on every x86 node. Without SSE2 the scalar kernel is used.
+ */
+
+#ifndef JSON_STRING_SCAN_H_
+#define JSON_STRING_SCAN_H_
+
+#include <stddef.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define JSON_SCAN_SSE2
+#include <emmintrin.h>
+// target specific intrinsics in functions with target attributes need gcc 4.9 or later
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define JSON_SCAN_DISPATCH
+#include <immintrin.h>
+#include <nmmintrin.h>
+#endif
+#endif
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	/*
+	 * A scan kernel returns the position of the first character in [str, str + length)
+	 * which needs escaping, or length if there is none.
+	 */
+	typedef size_t (*ScanEscapeFunction)(const char* str, size_t length);
+
+	inline bool needsEscape(unsigned char c) {
+		return c < 0x20 || c == '"' || c == '\\';
+	}
+
+	inline size_t scanEscapeScalar(const char* str, size_t length) {
+		size_t i = 0;
+		while(i < length && !needsEscape(static_cast<unsigned char>(str[i])))
+			i++;
+
+		return i;
+	}
+
+#ifdef JSON_SCAN_SSE2
+
+	inline size_t countTrailingZeros(unsigned mask) {
+		return static_cast<size_t>(__builtin_ctz(mask));
+	}
+
+	inline size_t scanEscapeSSE2(const char* str, size_t length) {
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1F);
+
+		size_t i = 0;
+		for(; i + 16 <= length; i += 16) {
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+			// unsigned s <= 0x1F is max(s, 0x1F) == 0x1F
+			__m128i x = _mm_cmpeq_epi8(_mm_max_epu8(s, control), control);
+			x = _mm_or_si128(x, _mm_cmpeq_epi8(s, quote));
+			x = _mm_or_si128(x, _mm_cmpeq_epi8(s, backslash));
+
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(x));
+			if(mask)
+				return i + countTrailingZeros(mask);
+		}
+
+		return i + scanEscapeScalar(str + i, length - i);
+	}
+
+#ifdef JSON_SCAN_DISPATCH
+
+	__attribute__((target("sse4.2")))
+	inline size_t scanEscapeSSE42(const char* str, size_t length) {
+		// ranges of characters to escape: 0x00-0x1F, '"', '\'
+		static const char ranges[16] = { '\0', '\x1F', '"', '"', '\\', '\\' };
+		const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+
+		size_t i = 0;
+		for(; i + 16 <= length; i += 16) {
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+			const int index = _mm_cmpestri(r, 6, s, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+			if(index != 16)
+				return i + static_cast<size_t>(index);
+		}
+
+		return i + scanEscapeScalar(str + i, length - i);
+	}
+
+	__attribute__((target("avx2")))
+	inline size_t scanEscapeAVX2(const char* str, size_t length) {
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i backslash = _mm256_set1_epi8('\\');
+		const __m256i control = _mm256_set1_epi8(0x1F);
+
+		size_t i = 0;
+		for(; i + 32 <= length; i += 32) {
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+			__m256i x = _mm256_cmpeq_epi8(_mm256_max_epu8(s, control), control);
+			x = _mm256_or_si256(x, _mm256_cmpeq_epi8(s, quote));
+			x = _mm256_or_si256(x, _mm256_cmpeq_epi8(s, backslash));
+
+			unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(x));
+			if(mask)
+				return i + countTrailingZeros(mask);
+		}
+
+		return i + scanEscapeSSE2(str + i, length - i);
+	}
+
+#endif /* JSON_SCAN_DISPATCH */
+#endif /* JSON_SCAN_SSE2 */
+
+	inline ScanEscapeFunction selectScanEscape() {
+#ifdef JSON_SCAN_DISPATCH
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			return scanEscapeAVX2;
+		if(__builtin_cpu_supports("sse4.2"))
+			return scanEscapeSSE42;
+#endif
+#ifdef JSON_SCAN_SSE2
+		return scanEscapeSSE2;
+#else
+		return scanEscapeScalar;
+#endif
+	}
+
+	inline size_t scanEscape(const char* str, size_t length) {
+		static const ScanEscapeFunction scan = selectScanEscape();
+		return scan(str, length);
+	}
+
+}}}}
+
+#endif /* JSON_STRING_SCAN_H_ */
@@ -0,0 +1,522 @@
+/*
+ * JsonTape.h
+ *
+ * Pre-parsed JSON documents, laid out as a tape of 64 bit words followed by a string table.
+ * The tape is written once by parseJSONToBlob and read in place, with no text parsing and
+ * no allocation, so it can be passed between operators or read from a mapped file.
+ *
+ * Layout, in native byte order:
+ *   header   magic, version, word count, string table size (4 x uint32)
+ *   words    one per null, boolean, string and integer fitting 56 bits, two per double
+ *            and wider integer (the value follows), a start word per object and array
+ *            holding the index past its end word and its member or element count
+ *            (saturated at kTapeCountMax) and an end word
+ *   strings  per string its uint32 length, its UTF-8 bytes and a terminating zero
+ * Values are addressed by word index, the root value is at index 0. Object members are
+ * a string word holding the key followed by the value.
+ */
+
+#ifndef JSON_TAPE_H_
+#define JSON_TAPE_H_
+
+#include "JsonConfig.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/pointer.h"
+#include "JsonLimits.h"
+
+#include <cstring>
+#include <limits>
+#include <stack>
+#include <string>
+#include <vector>
+
+#include <SPL/Runtime/Type/Tuple.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	const uint32_t kTapeMagic = 0x5041544a; // "JTAP" read as little endian
+	const uint32_t kTapeVersion = 1;
+	const size_t kTapeHeaderSize = 16;
+	const uint64_t kTapeCountMax = 0xffffff;
+	// integers of -2^55 to 2^55 - 1 are held in the 56 bit payload of their word
+	const int64_t kTapeInlineLimit = 0x80000000000000LL;
+
+	enum TapeTag {
+		kTapeNull = 'n',
+		kTapeTrue = 't',
+		kTapeFalse = 'f',
+		kTapeInt = 'i',
+		kTapeInt64 = 'l',
+		kTapeUint = 'u',
+		kTapeUint64 = 'U',
+		kTapeDouble = 'd',
+		kTapeString = 's',
+		kTapeStartArray = '[',
+		kTapeEndArray = ']',
+		kTapeStartObject = '{',
+		kTapeEndObject = '}'
+	};
+
+	inline uint64_t tapeWord(TapeTag tag, uint64_t payload) {
+		return (static_cast<uint64_t>(tag) << 56) | (payload & 0xffffffffffffffULL);
+	}
+
+	/*
+	 * RapidJSON SAX handler writing the tape, container start words are
+	 * completed when the container ends
+	 */
+	class TapeBuilder : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, TapeBuilder> {
+	public:
+		bool Null() { words_.push_back(tapeWord(kTapeNull, 0)); return true; }
+		bool Bool(bool b) { words_.push_back(tapeWord(b ? kTapeTrue : kTapeFalse, 0)); return true; }
+		bool Int(int i) { return Int64(i); }
+		bool Uint(unsigned u) { return Uint64(u); }
+
+		bool Int64(int64_t i) {
+			if(i >= -kTapeInlineLimit && i < kTapeInlineLimit)
+				words_.push_back(tapeWord(kTapeInt, static_cast<uint64_t>(i)));
+			else
+				Number(kTapeInt64, static_cast<uint64_t>(i));
+			return true;
+		}
+
+		bool Uint64(uint64_t u) {
+			if(u < static_cast<uint64_t>(kTapeInlineLimit))
+				words_.push_back(tapeWord(kTapeUint, u));
+			else
+				Number(kTapeUint64, u);
+			return true;
+		}
+
+		bool Double(double d) {
+			uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			return Number(kTapeDouble, bits);
+		}
+
+		bool String(const char* str, rapidjson::SizeType length, bool) {
+			words_.push_back(tapeWord(kTapeString, strings_.size()));
+
+			const uint32_t length32 = length;
+			strings_.append(reinterpret_cast<const char*>(&length32), sizeof(length32));
+			strings_.append(str, length);
+			strings_.push_back('\0');
+			return true;
+		}
+
+		bool Key(const char* str, rapidjson::SizeType length, bool copy) { return String(str, length, copy); }
+
+		bool StartObject() { return Start(kTapeStartObject); }
+		bool EndObject(rapidjson::SizeType memberCount) { return End(kTapeEndObject, memberCount); }
+		bool StartArray() { return Start(kTapeStartArray); }
+		bool EndArray(rapidjson::SizeType elementCount) { return End(kTapeEndArray, elementCount); }
+
+		void Clear() {
+			words_.clear();
+			strings_.clear();
+		}
+
+		/*
+		 * the tape as blob, written straight into the blob data
+		 */
+		SPL::blob ToBlob() const {
+			const size_t wordBytes = words_.size() * sizeof(uint64_t);
+			const size_t size = kTapeHeaderSize + wordBytes + strings_.size();
+
+			unsigned char* data = new unsigned char[size];
+			const uint32_t header[4] = { kTapeMagic, kTapeVersion, static_cast<uint32_t>(words_.size()), static_cast<uint32_t>(strings_.size()) };
+			std::memcpy(data, header, kTapeHeaderSize);
+			if(wordBytes)
+				std::memcpy(data + kTapeHeaderSize, &words_[0], wordBytes);
+			if(!strings_.empty())
+				std::memcpy(data + kTapeHeaderSize + wordBytes, strings_.data(), strings_.size());
+
+			SPL::blob tape;
+			tape.adoptData(data, size);
+			return tape;
+		}
+
+	private:
+		bool Number(TapeTag tag, uint64_t value) {
+			words_.push_back(tapeWord(tag, 0));
+			words_.push_back(value);
+			return true;
+		}
+
+		bool Start(TapeTag tag) {
+			starts_.push(words_.size());
+			words_.push_back(tapeWord(tag, 0));
+			return true;
+		}
+
+		bool End(TapeTag tag, rapidjson::SizeType count) {
+			const size_t start = starts_.top();
+			starts_.pop();
+
+			words_.push_back(tapeWord(tag, start));
+
+			const uint64_t saturated = count < kTapeCountMax ? count : kTapeCountMax;
+			words_[start] = tapeWord(static_cast<TapeTag>(words_[start] >> 56), (saturated << 32) | words_.size());
+			return true;
+		}
+
+		std::vector<uint64_t> words_;
+		std::string strings_;
+		std::stack<size_t> starts_;
+	};
+
+	/*
+	 * Read access to a tape held in memory owned by the caller. Words and strings are
+	 * bounds checked when read, reads outside of the tape give null values and empty
+	 * strings, so a corrupt tape is never read beyond its end.
+	 */
+	class TapeView {
+	public:
+		TapeView() : words_(0), wordCount_(0), strings_(0), stringBytes_(0) {}
+
+		/*
+		 * attaches the view to a tape, false if the data holds no tape of this version
+		 */
+		bool Attach(const char* data, size_t size) {
+			*this = TapeView();
+
+			uint32_t header[4];
+			if(size < kTapeHeaderSize)
+				return false;
+			std::memcpy(header, data, kTapeHeaderSize);
+
+			const uint64_t expected = kTapeHeaderSize + static_cast<uint64_t>(header[2]) * sizeof(uint64_t) + header[3];
+			if(header[0] != kTapeMagic || header[1] != kTapeVersion || header[2] == 0 || expected > size)
+				return false;
+
+			words_ = data + kTapeHeaderSize;
+			wordCount_ = header[2];
+			strings_ = words_ + wordCount_ * sizeof(uint64_t);
+			stringBytes_ = header[3];
+			return true;
+		}
+
+		bool IsAttached() const { return wordCount_ != 0; }
+
+		size_t WordCount() const { return wordCount_; }
+
+		uint64_t Word(size_t index) const {
+			if(index >= wordCount_)
+				return tapeWord(kTapeNull, 0);
+
+			uint64_t word;
+			std::memcpy(&word, words_ + index * sizeof(uint64_t), sizeof(word));
+			return word;
+		}
+
+		const char* String(uint64_t offset, rapidjson::SizeType & length) const {
+			uint32_t length32;
+			if(offset + sizeof(length32) > stringBytes_) {
+				length = 0;
+				return "";
+			}
+			std::memcpy(&length32, strings_ + offset, sizeof(length32));
+
+			if(offset + sizeof(length32) + length32 + 1 > stringBytes_ || strings_[offset + sizeof(length32) + length32] != '\0') {
+				length = 0;
+				return "";
+			}
+			length = length32;
+			return strings_ + offset + sizeof(length32);
+		}
+
+	private:
+		const char* words_;
+		size_t wordCount_;
+		const char* strings_;
+		size_t stringBytes_;
+	};
+
+	class TapeIterator;
+
+	/*
+	 * A value of a tape, with the accessors of rapidjson::Value used by queryJSON.
+	 * Numbers convert between their types as RapidJSON values do.
+	 */
+	class TapeValue {
+	public:
+		typedef TapeIterator ConstValueIterator;
+
+		TapeValue() : tape_(0), index_(0) {}
+		TapeValue(TapeView const* tape, size_t index) : tape_(tape), index_(index) {}
+
+		size_t Index() const { return index_; }
+
+		rapidjson::Type GetType() const {
+			switch(Tag()) {
+				case kTapeTrue : return rapidjson::kTrueType;
+				case kTapeFalse : return rapidjson::kFalseType;
+				case kTapeInt :
+				case kTapeInt64 :
+				case kTapeUint :
+				case kTapeUint64 :
+				case kTapeDouble : return rapidjson::kNumberType;
+				case kTapeString : return rapidjson::kStringType;
+				case kTapeStartArray : return rapidjson::kArrayType;
+				case kTapeStartObject : return rapidjson::kObjectType;
+				default : return rapidjson::kNullType;
+			}
+		}
+
+		bool IsNull() const { return GetType() == rapidjson::kNullType; }
+		bool IsBool() const { return Tag() == kTapeTrue || Tag() == kTapeFalse; }
+		bool IsNumber() const { return GetType() == rapidjson::kNumberType; }
+		bool IsString() const { return Tag() == kTapeString; }
+		bool IsArray() const { return Tag() == kTapeStartArray; }
+		bool IsObject() const { return Tag() == kTapeStartObject; }
+
+		bool IsInt64() const {
+			switch(Tag()) {
+				case kTapeInt :
+				case kTapeInt64 :
+				case kTapeUint : return true;
+				case kTapeUint64 : return Integer() <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+				default : return false;
+			}
+		}
+
+		bool GetBool() const { return Tag() == kTapeTrue; }
+
+		int64_t GetInt64() const {
+			return Tag() == kTapeDouble ? static_cast<int64_t>(GetDouble()) : static_cast<int64_t>(Integer());
+		}
+
+		uint64_t GetUint64() const {
+			return Tag() == kTapeDouble ? static_cast<uint64_t>(GetDouble()) : Integer();
+		}
+
+		int GetInt() const { return static_cast<int>(GetInt64()); }
+		unsigned GetUint() const { return static_cast<unsigned>(GetUint64()); }
+
+		double GetDouble() const {
+			switch(Tag()) {
+				case kTapeInt :
+				case kTapeInt64 : return static_cast<double>(static_cast<int64_t>(Integer()));
+				case kTapeUint :
+				case kTapeUint64 : return static_cast<double>(Integer());
+				case kTapeDouble : {
+					const uint64_t bits = tape_->Word(index_ + 1);
+					double d;
+					std::memcpy(&d, &bits, sizeof(d));
+					return d;
+				}
+				default : return 0.0;
+			}
+		}
+
+		float GetFloat() const { return static_cast<float>(GetDouble()); }
+
+		const char* GetString() const {
+			rapidjson::SizeType length;
+			return tape_->String(Word() & 0xffffffffffffffULL, length);
+		}
+
+		rapidjson::SizeType GetStringLength() const {
+			rapidjson::SizeType length;
+			tape_->String(Word() & 0xffffffffffffffULL, length);
+			return length;
+		}
+
+		/*
+		 * number of members or elements, counted on the tape when saturated
+		 */
+		rapidjson::SizeType Size() const {
+			const uint64_t count = (Word() >> 32) & kTapeCountMax;
+			if(count < kTapeCountMax)
+				return static_cast<rapidjson::SizeType>(count);
+
+			rapidjson::SizeType size = 0;
+			for(size_t i = index_ + 1; i < EndIndex(); i = Next(i))
+				size++;
+			return IsObject() ? size / 2 : size;
+		}
+
+		ConstValueIterator Begin() const;
+		ConstValueIterator End() const;
+
+		/*
+		 * first member of an object with the given name, as RapidJSON's FindMember
+		 */
+		bool FindMember(const char* name, rapidjson::SizeType length, TapeValue & member) const {
+			if(!IsObject())
+				return false;
+
+			for(size_t i = index_ + 1; i < EndIndex(); i = Next(Next(i))) {
+				TapeValue key(tape_, i);
+				if(key.GetStringLength() == length && std::memcmp(key.GetString(), name, length) == 0) {
+					member = TapeValue(tape_, i + 1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool Element(rapidjson::SizeType position, TapeValue & element) const {
+			if(!IsArray())
+				return false;
+
+			size_t i = index_ + 1;
+			for(; i < EndIndex() && position > 0; position--)
+				i = Next(i);
+
+			if(i >= EndIndex())
+				return false;
+
+			element = TapeValue(tape_, i);
+			return true;
+		}
+
+		/*
+		 * value at a JSON pointer below this value, resolved as by rapidjson::Pointer::Get
+		 */
+		bool Get(rapidjson::Pointer const& pointer, TapeValue & value) const {
+			value = *this;
+
+			for(size_t i = 0; i < pointer.GetTokenCount(); i++) {
+				rapidjson::Pointer::Token const& token = pointer.GetTokens()[i];
+
+				if(value.IsObject()) {
+					if(!value.FindMember(token.name, token.length, value))
+						return false;
+				}
+				else if(value.IsArray()) {
+					if(token.index == rapidjson::kPointerInvalidIndex || !value.Element(token.index, value))
+						return false;
+				}
+				else {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		template<typename Handler>
+		bool Accept(Handler & handler) const {
+			switch(Tag()) {
+				case kTapeTrue : return handler.Bool(true);
+				case kTapeFalse : return handler.Bool(false);
+				case kTapeInt :
+				case kTapeInt64 : return handler.Int64(GetInt64());
+				case kTapeUint :
+				case kTapeUint64 : return handler.Uint64(GetUint64());
+				case kTapeDouble : return handler.Double(GetDouble());
+				case kTapeString : return handler.String(GetString(), GetStringLength(), false);
+				case kTapeStartArray : {
+					if(!handler.StartArray())
+						return false;
+					rapidjson::SizeType count = 0;
+					for(size_t i = index_ + 1; i < EndIndex(); i = Next(i), count++) {
+						if(!TapeValue(tape_, i).Accept(handler))
+							return false;
+					}
+					return handler.EndArray(count);
+				}
+				case kTapeStartObject : {
+					if(!handler.StartObject())
+						return false;
+					rapidjson::SizeType count = 0;
+					for(size_t i = index_ + 1; i < EndIndex(); i = Next(Next(i)), count++) {
+						TapeValue key(tape_, i);
+						if(!handler.Key(key.GetString(), key.GetStringLength(), false) || !TapeValue(tape_, i + 1).Accept(handler))
+							return false;
+					}
+					return handler.EndObject(count);
+				}
+				default : return handler.Null();
+			}
+		}
+
+		// the value following this one
+		TapeValue Following() const { return TapeValue(tape_, Next(index_)); }
+
+	private:
+		uint64_t Word() const { return tape_->Word(index_); }
+		TapeTag Tag() const { return static_cast<TapeTag>(Word() >> 56); }
+		// value of an integer, inline ones are sign extended from 56 bits
+		uint64_t Integer() const {
+			switch(Tag()) {
+				case kTapeInt : return static_cast<uint64_t>(static_cast<int64_t>(Word() << 8) >> 8);
+				case kTapeUint : return Word() & 0xffffffffffffffULL;
+				default : return tape_->Word(index_ + 1);
+			}
+		}
+
+		// index of the end word of a container, never before its first child
+		size_t EndIndex() const {
+			const size_t end = static_cast<size_t>(Word() & 0xffffffff) - 1;
+			return end > index_ && end < tape_->WordCount() ? end : index_ + 1;
+		}
+
+		size_t Next(size_t index) const {
+			TapeValue value(tape_, index);
+			switch(value.Tag()) {
+				case kTapeInt64 :
+				case kTapeUint64 :
+				case kTapeDouble : return index + 2;
+				case kTapeStartArray :
+				case kTapeStartObject : return value.EndIndex() + 1;
+				default : return index + 1;
+			}
+		}
+
+		TapeView const* tape_;
+		size_t index_;
+	};
+
+	class TapeIterator {
+	public:
+		explicit TapeIterator(TapeValue const& value) : value_(value) {}
+
+		TapeValue const& operator*() const { return value_; }
+		TapeValue const* operator->() const { return &value_; }
+
+		TapeIterator& operator++() {
+			value_ = value_.Following();
+			return *this;
+		}
+
+		bool operator==(TapeIterator const& other) const { return value_.Index() == other.value_.Index(); }
+		bool operator!=(TapeIterator const& other) const { return !(*this == other); }
+
+	private:
+		TapeValue value_;
+	};
+
+	inline TapeValue::ConstValueIterator TapeValue::Begin() const {
+		return TapeIterator(TapeValue(tape_, IsArray() ? index_ + 1 : index_));
+	}
+
+	inline TapeValue::ConstValueIterator TapeValue::End() const {
+		return TapeIterator(TapeValue(tape_, IsArray() ? EndIndex() : index_));
+	}
+
+	/*
+	 * tape of a JSON document, an empty blob if the document is no valid JSON
+	 */
+	template<typename Status>
+	inline SPL::blob parseJSONToBlob(SPL::rstring const& jsonString, Status & status, uint32_t & offset) {
+		TapeBuilder builder;
+		rapidjson::StringStream jsonStream(jsonString.c_str());
+
+		const rapidjson::ParseResult result = parseWithLimits<rapidjson::kParseStopWhenDoneFlag, rapidjson::UTF8<> >(jsonStream, builder);
+		status = result.Code();
+		offset = static_cast<uint32_t>(result.Offset());
+
+		return result.IsError() ? SPL::blob() : builder.ToBlob();
+	}
+
+	inline SPL::blob parseJSONToBlob(SPL::rstring const& jsonString) {
+		rapidjson::ParseErrorCode status = rapidjson::kParseErrorNone;
+		uint32_t offset = 0;
+
+		return parseJSONToBlob(jsonString, status, offset);
+	}
+
+}}}}
+
+#endif /* JSON_TAPE_H_ */
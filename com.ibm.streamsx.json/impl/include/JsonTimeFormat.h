@@ -0,0 +1,352 @@
+/*
+ * JsonTimeFormat.h
+ *
+ * Timestamp formatting for the writer and parsing for the reader. Timestamps
+ * are given as seconds and nanoseconds since the Unix epoch (UTC) and are
+ * converted without calls into libc and without memory allocation. The date of
+ * the last formatted day is kept, timestamps of an event stream mostly fall on
+ * the same day.
+ */
+
+#ifndef JSON_TIME_FORMAT_H_
+#define JSON_TIME_FORMAT_H_
+
+#include "JsonNumberFormat.h"
+
+#include <cstring>
+#include <stdint.h>
+
+namespace com { namespace ibm { namespace streamsx { namespace json {
+
+	// upper bound of the formatted length, without the eight bytes of slack
+	const size_t kMaxIso8601Length = 40;
+
+	const int64_t kSecondsPerDay = 86400;
+
+	inline int64_t floorDiv(int64_t a, int64_t b) {
+		int64_t q = a / b;
+		return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+	}
+
+	/*
+	 * proleptic Gregorian year, month (1-12) and day (1-31) of a day count since 1970-01-01,
+	 * after H. Hinnant, "chrono-Compatible Low-Level Date Algorithms"
+	 */
+	inline void civilFromDays(int64_t days, int64_t & year, unsigned & month, unsigned & day) {
+		days += 719468;
+		const int64_t era = floorDiv(days, 146097);
+		const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+		const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+		const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+
+		day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+		month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+		year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+	}
+
+	/*
+	 * day count since 1970-01-01 of a proleptic Gregorian date, the inverse of civilFromDays
+	 */
+	inline int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+		year -= month <= 2 ? 1 : 0;
+		const int64_t era = floorDiv(year, 400);
+		const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+		const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+		return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+	}
+
+	inline unsigned daysInMonth(int64_t year, unsigned month) {
+		static const unsigned char days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		if(month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+			return 29;
+
+		return days[month - 1];
+	}
+
+	inline char* writeDigits2(unsigned n, char* out) {
+		out[0] = static_cast<char>('0' + n / 10);
+		out[1] = static_cast<char>('0' + n % 10);
+		return out + 2;
+	}
+
+	/*
+	 * seconds and nanoseconds as epoch milliseconds, truncated toward the past,
+	 * false if the value is outside of the int64 range (about 292 million years)
+	 */
+	inline bool epochMillis(int64_t seconds, uint32_t nanoseconds, int64_t & millis) {
+		const int64_t limit = 9223372036854774LL;
+		if(seconds > limit || seconds < -limit)
+			return false;
+
+		millis = seconds * 1000 + static_cast<int64_t>(nanoseconds / 1000000);
+		return true;
+	}
+
+	/*
+	 * seconds and nanoseconds as epoch nanoseconds, false if the value
+	 * is outside of the int64 range (before 1677 or after 2262)
+	 */
+	inline bool epochNanos(int64_t seconds, uint32_t nanoseconds, int64_t & nanos) {
+		const int64_t limit = 9223372035LL;
+		if(seconds > limit || seconds < -limit)
+			return false;
+
+		nanos = seconds * 1000000000 + static_cast<int64_t>(nanoseconds);
+		return true;
+	}
+
+	/*
+	 * Units of epoch numbers, the values follow JsonEpochUnit.unit
+	 */
+	enum EpochUnit {
+		kEpochAuto = 0,
+		kEpochSeconds = 1,
+		kEpochMillis = 2,
+		kEpochMicros = 3,
+		kEpochNanos = 4
+	};
+
+	/*
+	 * unit of an epoch number following from its magnitude: below 10^11 seconds,
+	 * below 10^14 milliseconds, below 10^17 microseconds and nanoseconds above.
+	 * Seconds cover the years up to 5138, the other units the times after March 1973,
+	 * so earlier milliseconds, e.g. 63072000000 for 1972-01-01, are taken as seconds.
+	 */
+	inline EpochUnit epochUnitOf(int64_t value) {
+		const uint64_t magnitude = value < 0 ? ~static_cast<uint64_t>(value) + 1 : static_cast<uint64_t>(value);
+
+		if(magnitude < 100000000000ULL)
+			return kEpochSeconds;
+		if(magnitude < 100000000000000ULL)
+			return kEpochMillis;
+		if(magnitude < 100000000000000000ULL)
+			return kEpochMicros;
+		return kEpochNanos;
+	}
+
+	/*
+	 * seconds and nanoseconds of an epoch number in the given unit, see epochUnitOf for kEpochAuto
+	 */
+	inline void fromEpoch(int64_t value, EpochUnit unit, int64_t & seconds, uint32_t & nanoseconds) {
+		static const int64_t unitsPerSecond[] = { 1, 1, 1000, 1000000, 1000000000 };
+
+		if(unit == kEpochAuto)
+			unit = epochUnitOf(value);
+
+		if(unit == kEpochSeconds) {
+			seconds = value;
+			nanoseconds = 0;
+			return;
+		}
+
+		seconds = floorDiv(value, unitsPerSecond[unit]);
+		nanoseconds = static_cast<uint32_t>((value - seconds * unitsPerSecond[unit]) * (1000000000 / unitsPerSecond[unit]));
+	}
+
+	/*
+	 * floating point epoch number, seconds may have a fraction and the other units
+	 * are truncated, false if not finite
+	 */
+	inline bool fromEpoch(double value, EpochUnit unit, int64_t & seconds, uint32_t & nanoseconds) {
+		if(!(value > -9.2e18 && value < 9.2e18))
+			return false;
+
+		if(unit == kEpochSeconds || (unit == kEpochAuto && value > -1e11 && value < 1e11)) {
+			double whole = static_cast<double>(static_cast<int64_t>(value));
+			if(whole > value)
+				whole -= 1;
+
+			seconds = static_cast<int64_t>(whole);
+			int64_t nanos = static_cast<int64_t>((value - whole) * 1e9 + 0.5);
+			if(nanos >= 1000000000) {
+				seconds++;
+				nanos -= 1000000000;
+			}
+			nanoseconds = static_cast<uint32_t>(nanos);
+			return true;
+		}
+
+		fromEpoch(static_cast<int64_t>(value), unit, seconds, nanoseconds);
+		return true;
+	}
+
+	inline unsigned digitValue(char c) {
+		return static_cast<unsigned>(static_cast<unsigned char>(c) - '0');
+	}
+
+	// two digits at str, more than 99 if one of them is no digit
+	inline unsigned parseDigits2(const char* str) {
+		const unsigned high = digitValue(str[0]);
+		const unsigned low = digitValue(str[1]);
+
+		return (high > 9) | (low > 9) ? 100 : high * 10 + low;
+	}
+
+	/*
+	 * Parses an ISO-8601 date and time YYYY-MM-DDThh:mm:ss with an optional fraction of
+	 * up to nine significant digits and a time zone Z, +hh:mm, +hhmm or +hh (or with -).
+	 * 't' or ' ' are accepted as separator and 'z' as zone, years may have a sign and
+	 * more than four digits. The fields are at fixed positions and are checked without
+	 * a format interpreter. Returns false if the string is no such date and time.
+	 */
+	inline bool parseIso8601(const char* str, size_t length, int64_t & seconds, uint32_t & nanoseconds) {
+		const char* p = str;
+		const char* end = str + length;
+
+		bool negativeYear = false;
+		if(p != end && (*p == '+' || *p == '-'))
+			negativeYear = *p++ == '-';
+
+		int64_t year = 0;
+		const char* yearBegin = p;
+		while(p != end && digitValue(*p) <= 9 && p - yearBegin < 12)
+			year = year * 10 + digitValue(*p++);
+		if(p - yearBegin < 4)
+			return false;
+		if(negativeYear)
+			year = -year;
+
+		// -MM-DDThh:mm:ss
+		if(end - p < 15 || p[0] != '-' || p[3] != '-' || p[9] != ':' || p[12] != ':')
+			return false;
+		if(p[6] != 'T' && p[6] != 't' && p[6] != ' ')
+			return false;
+
+		const unsigned month = parseDigits2(p + 1);
+		const unsigned day = parseDigits2(p + 4);
+		const unsigned hour = parseDigits2(p + 7);
+		const unsigned minute = parseDigits2(p + 10);
+		const unsigned second = parseDigits2(p + 13);
+		if(month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 || minute > 59 || second > 60)
+			return false;
+		p += 15;
+
+		uint32_t fraction = 0;
+		if(p != end && (*p == '.' || *p == ',')) {
+			const char* fractionBegin = ++p;
+			unsigned scale = 1000000000;
+			while(p != end && digitValue(*p) <= 9) {
+				if(scale > 1) {
+					scale /= 10;
+					fraction += digitValue(*p) * scale;
+				}
+				p++;
+			}
+			if(p == fractionBegin)
+				return false;
+		}
+
+		int64_t offset = 0;
+		if(p != end && (*p == 'Z' || *p == 'z')) {
+			p++;
+		}
+		else if(p != end && (*p == '+' || *p == '-')) {
+			const int64_t sign = *p++ == '-' ? -1 : 1;
+			if(end - p < 2)
+				return false;
+
+			const unsigned offsetHours = parseDigits2(p);
+			unsigned offsetMinutes = 0;
+			p += 2;
+			if(p != end && *p == ':')
+				p++;
+			if(end - p >= 2) {
+				offsetMinutes = parseDigits2(p);
+				p += 2;
+			}
+			if(offsetHours > 23 || offsetMinutes > 59)
+				return false;
+
+			offset = sign * static_cast<int64_t>(offsetHours * 3600 + offsetMinutes * 60);
+		}
+		else {
+			return false;
+		}
+
+		if(p != end)
+			return false;
+
+		seconds = daysFromCivil(year, month, day) * kSecondsPerDay + hour * 3600 + minute * 60 + second - offset;
+		nanoseconds = fraction;
+		return true;
+	}
+
+	/*
+	 * ISO-8601 UTC formatter, e.g. 2017-10-17T08:15:30.250Z. The fraction of a second
+	 * is omitted when zero and written with 3, 6 or 9 digits otherwise, years outside
+	 * of 0000-9999 get a sign and as many digits as needed.
+	 */
+	class Iso8601Format {
+	public:
+		Iso8601Format() : day_(0), dateLength_(0) {}
+
+		char* format(int64_t seconds, uint32_t nanoseconds, char* out) {
+			seconds += nanoseconds / 1000000000;
+			nanoseconds %= 1000000000;
+
+			const int64_t day = floorDiv(seconds, kSecondsPerDay);
+			if(dateLength_ == 0 || day != day_)
+				formatDate(day);
+
+			std::memcpy(out, date_, dateLength_);
+			out += dateLength_;
+
+			unsigned secondOfDay = static_cast<unsigned>(seconds - day * kSecondsPerDay);
+			*out++ = 'T';
+			out = writeDigits2(secondOfDay / 3600, out);
+			*out++ = ':';
+			out = writeDigits2(secondOfDay / 60 % 60, out);
+			*out++ = ':';
+			out = writeDigits2(secondOfDay % 60, out);
+
+			if(nanoseconds) {
+				*out++ = '.';
+				// all nine digits are written, the output ends after the last significant group
+				*out = static_cast<char>('0' + nanoseconds / 100000000);
+				writeDigits8(nanoseconds % 100000000, out + 1);
+				out += nanoseconds % 1000000 == 0 ? 3 : nanoseconds % 1000 == 0 ? 6 : 9;
+			}
+			*out++ = 'Z';
+
+			return out;
+		}
+
+	private:
+		void formatDate(int64_t day) {
+			int64_t year;
+			unsigned month, dayOfMonth;
+			civilFromDays(day, year, month, dayOfMonth);
+
+			char* out = date_;
+			if(year >= 0 && year <= 9999) {
+				out = writeDigits2(static_cast<unsigned>(year / 100), out);
+				out = writeDigits2(static_cast<unsigned>(year % 100), out);
+			}
+			else {
+				*out++ = year < 0 ? '-' : '+';
+				uint64_t absoluteYear = static_cast<uint64_t>(year < 0 ? -year : year);
+				for(uint64_t digits = 1000; digits > absoluteYear && digits > 1; digits /= 10)
+					*out++ = '0';
+				out = u64toa(absoluteYear, out);
+			}
+			*out++ = '-';
+			out = writeDigits2(month, out);
+			*out++ = '-';
+			out = writeDigits2(dayOfMonth, out);
+
+			day_ = day;
+			dateLength_ = static_cast<size_t>(out - date_);
+		}
+
+		int64_t day_;
+		// room for a sign, the digits of an int64 year and "-MM-DD" plus eight bytes of slack
+		char date_[48];
+		size_t dateLength_;
+	};
+
+}}}}
+
+#endif /* JSON_TIME_FORMAT_H_ */
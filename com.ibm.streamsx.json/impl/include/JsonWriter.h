@@ -13,9 +13,25 @@
 #include "SPL/Runtime/Function/TimeFunctions.h"
 #include <SPL/Runtime/Type/Tuple.h>
 
+#include "JsonConfig.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
+#include "JsonBase64.h"
+#include "JsonHash.h"
+#include "JsonMemory.h"
+#include "JsonNumberFormat.h"
+#include "JsonStringScan.h"
+#include "JsonTimeFormat.h"
 #include <streams_boost/algorithm/string.hpp>
+#include <streams_boost/thread/mutex.hpp>
+#include <streams_boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#include <typeinfo>
+#include <vector>
 
 
 
@@ -23,43 +39,380 @@
 
 namespace com { namespace ibm { namespace streamsx { namespace json {
 
-	template<typename String>
-	inline char const* convToChars(String const& str) { return str.c_str(); }
+	/*
+	 * Writer options, the bit positions follow the values of JsonWriterOption.option
+	 */
+	enum WriterFlag {
+		kWriteDecimalAsString = 1 << 0,
+		kWriteTimestampEpochMillis = 1 << 1,
+		kWriteTimestampEpochNanos = 1 << 2,
+		kWriteTimestampISO8601 = 1 << 3,
+		kWriteOmitNulls = 1 << 4,
+		kWriteOmitDefaults = 1 << 5,
+		kWriteOmitEmptyCollections = 1 << 6,
+		kWriteCanonical = 1 << 7,
+		kWriteOmitMask = kWriteOmitNulls | kWriteOmitDefaults | kWriteOmitEmptyCollections
+	};
 
-	template<>
-	inline char const* convToChars<SPL::ustring>(SPL::ustring const& str) { return SPL::spl_cast<SPL::rstring,SPL::ustring>::cast(str).c_str(); }
+	template<class Options>
+	inline uint32_t getWriterFlags(Options const& options) {
+		uint32_t flags = 0;
+		for(typename Options::const_iterator it = options.begin(); it != options.end(); ++it)
+			flags |= 1u << it->getIndex();
 
-	template<>
-	inline char const* convToChars<SPL::ConstValueHandle>(const SPL::ConstValueHandle& valueHandle) {
+		return flags;
+	}
+
+	/*
+	 * RapidJSON writer which additionally accepts UTF-16 strings.
+	 * They are transcoded straight into the UTF-8 output buffer with
+	 * the same escaping RapidJSON applies to UTF-8 strings, so that
+	 * ustring values need no intermediate rstring conversion.
+	 */
+	class JsonWriter : public rapidjson::Writer<rapidjson::StringBuffer> {
+	public:
+		typedef rapidjson::Writer<rapidjson::StringBuffer> Base;
+		using Base::String;
+
+		explicit JsonWriter(rapidjson::StringBuffer & os) : Base(os), flags_(0) {}
+
+		uint32_t GetFlags() const { return flags_; }
+		void SetFlags(uint32_t flags) { flags_ = flags; }
+
+		/*
+		 * writes a UTF-8 string like the RapidJSON writer, runs of characters
+		 * which need no escaping are found by the scan kernel and copied at once
+		 */
+		bool String(const char* str, rapidjson::SizeType length, bool copy = false) {
+			(void)copy;
+			Prefix(rapidjson::kStringType);
+			return EndValue(WriteUTF8String(str, length));
+		}
+
+		bool String(const UChar* str, rapidjson::SizeType length) {
+			Prefix(rapidjson::kStringType);
+			return EndValue(WriteUTF16String(str, length));
+		}
+
+		/*
+		 * writes a float64 like the RapidJSON writer, integral values
+		 * below 2^53 are formatted as integers without digit generation
+		 */
+		bool Double(double d) {
+			if(rapidjson::internal::Double(d).IsNanOrInf())
+				return Base::Double(d);
+			if(d == 0 && (flags_ & kWriteCanonical))
+				d = 0;
+
+			Prefix(rapidjson::kNumberType);
+
+			char buffer[kMaxDoubleLength + 8];
+			char* end = dtoa(d, buffer, maxDecimalPlaces_);
+
+			return EndValue(WriteRawValue(buffer, static_cast<size_t>(end - buffer)));
+		}
+
+		/*
+		 * writes a float32 with the shortest digits reading back to the same value
+		 */
+		bool Float(float f) {
+			if(rapidjson::internal::Double(f).IsNanOrInf())
+				return Base::Double(f);
+			if(f == 0 && (flags_ & kWriteCanonical))
+				f = 0;
+
+			Prefix(rapidjson::kNumberType);
+
+			char buffer[kMaxDoubleLength + 8];
+			char* end = ftoa(f, buffer, maxDecimalPlaces_);
+
+			return EndValue(WriteRawValue(buffer, static_cast<size_t>(end - buffer)));
+		}
+
+		/*
+		 * writes a timestamp as ISO-8601 UTC string, the date of
+		 * the previous timestamp is reused when it falls on the same day
+		 */
+		bool Iso8601(int64_t seconds, uint32_t nanoseconds) {
+			Prefix(rapidjson::kStringType);
+
+			char buffer[kMaxIso8601Length + 8];
+			buffer[0] = '"';
+			char* end = iso8601_.format(seconds, nanoseconds, buffer + 1);
+			*end++ = '"';
+
+			return EndValue(WriteRawValue(buffer, static_cast<size_t>(end - buffer)));
+		}
+
+		/*
+		 * writes binary data as base64 string, encoded straight into the output buffer
+		 */
+		bool Base64(const unsigned char* data, size_t size) {
+			Prefix(rapidjson::kStringType);
+
+			const size_t length = 2 + base64EncodedLength(size);
+			char* out = os_->Push(length);
+			*out++ = '"';
+			out = encodeBase64(data, size, out);
+			*out = '"';
+
+			return EndValue(true);
+		}
+
+		/*
+		 * writes an array of numbers held contiguously as one value. The output is
+		 * reserved once for the largest possible length and the numbers are formatted
+		 * straight into it. Floating point values have to be finite.
+		 */
+		template<typename T>
+		bool NumberArray(const T* values, size_t count) {
+			Prefix(rapidjson::kArrayType);
+
+			const size_t reserved = 2 + count * (maxNumberLength(values) + 1) + 8;
+			char* begin = os_->Push(reserved);
+			char* out = begin;
+
+			*out++ = '[';
+			for(size_t i = 0; i < count; i++) {
+				if(i)
+					*out++ = ',';
+				out = formatNumber(values[i], out);
+			}
+			*out++ = ']';
+
+			os_->Pop(reserved - static_cast<size_t>(out - begin));
+			return EndValue(true);
+		}
+
+		/*
+		 * writes an object key given as escaped and quoted bytes,
+		 * the separating comma and colon are still maintained by the writer
+		 */
+		bool RawKey(const char* quotedKey, size_t length) {
+			Prefix(rapidjson::kStringType);
+			std::memcpy(os_->Push(length), quotedKey, length);
+			return EndValue(true);
+		}
+
+	private:
+		template<typename T>
+		static size_t maxNumberLength(const T*) { return sizeof(T) > 4 ? kMaxInt64Length : kMaxInt32Length; }
+		static size_t maxNumberLength(const float*) { return kMaxDoubleLength; }
+		static size_t maxNumberLength(const double*) { return kMaxDoubleLength; }
+
+		char* formatNumber(int8_t value, char* out) const { return i32toa(value, out); }
+		char* formatNumber(int16_t value, char* out) const { return i32toa(value, out); }
+		char* formatNumber(int32_t value, char* out) const { return i32toa(value, out); }
+		char* formatNumber(int64_t value, char* out) const { return i64toa(value, out); }
+		char* formatNumber(uint8_t value, char* out) const { return u32toa(value, out); }
+		char* formatNumber(uint16_t value, char* out) const { return u32toa(value, out); }
+		char* formatNumber(uint32_t value, char* out) const { return u32toa(value, out); }
+		char* formatNumber(uint64_t value, char* out) const { return u64toa(value, out); }
+		// canonical output writes negative zero as zero
+		char* formatNumber(float value, char* out) const { return ftoa(value == 0 && (flags_ & kWriteCanonical) ? 0 : value, out, maxDecimalPlaces_); }
+		char* formatNumber(double value, char* out) const { return dtoa(value == 0 && (flags_ & kWriteCanonical) ? 0 : value, out, maxDecimalPlaces_); }
+
+		void PutEscaped(unsigned c) {
+			static const char hexDigits[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+			rapidjson::PutUnsafe(*os_, '\\');
+			switch(c) {
+				case '"': rapidjson::PutUnsafe(*os_, '"'); break;
+				case '\\': rapidjson::PutUnsafe(*os_, '\\'); break;
+				case '\b': rapidjson::PutUnsafe(*os_, 'b'); break;
+				case '\f': rapidjson::PutUnsafe(*os_, 'f'); break;
+				case '\n': rapidjson::PutUnsafe(*os_, 'n'); break;
+				case '\r': rapidjson::PutUnsafe(*os_, 'r'); break;
+				case '\t': rapidjson::PutUnsafe(*os_, 't'); break;
+				default:
+					rapidjson::PutUnsafe(*os_, 'u');
+					rapidjson::PutUnsafe(*os_, '0');
+					rapidjson::PutUnsafe(*os_, '0');
+					rapidjson::PutUnsafe(*os_, hexDigits[c >> 4]);
+					rapidjson::PutUnsafe(*os_, hexDigits[c & 0xF]);
+			}
+		}
+
+		bool WriteUTF8String(const char* str, rapidjson::SizeType length) {
+
+			// an escaped character takes at most 6 output bytes
+			rapidjson::PutReserve(*os_, 2 + length * 6);
+			rapidjson::PutUnsafe(*os_, '\"');
+
+			size_t i = 0;
+			while(i < length) {
+				size_t run = scanEscape(str + i, length - i);
+				if(run) {
+					std::memcpy(os_->PushUnsafe(run), str + i, run);
+					i += run;
+				}
+				if(i < length) {
+					PutEscaped(static_cast<unsigned char>(str[i]));
+					i++;
+				}
+			}
+
+			rapidjson::PutUnsafe(*os_, '\"');
+			return true;
+		}
+
+		bool WriteUTF16String(const UChar* str, rapidjson::SizeType length) {
+
+			// a UTF-16 code unit takes at most 6 output bytes, either escaped or as UTF-8
+			rapidjson::PutReserve(*os_, 2 + length * 6);
+			rapidjson::PutUnsafe(*os_, '\"');
+
+			const UChar* end = str + length;
+			while(str != end) {
+				unsigned codepoint = *str++;
+
+				if(codepoint < 0x80) {
+					if(needsEscape(static_cast<unsigned char>(codepoint)))
+						PutEscaped(codepoint);
+					else
+						rapidjson::PutUnsafe(*os_, static_cast<char>(codepoint));
+					continue;
+				}
+
+				if(codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+					// combine a surrogate pair, a lone surrogate becomes U+FFFD
+					if(codepoint <= 0xDBFF && str != end && *str >= 0xDC00 && *str <= 0xDFFF) {
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (*str++ - 0xDC00);
+					}
+					else {
+						codepoint = 0xFFFD;
+					}
+				}
+				rapidjson::UTF8<>::EncodeUnsafe(*os_, codepoint);
+			}
+
+			rapidjson::PutUnsafe(*os_, '\"');
+			return true;
+		}
+
+		uint32_t flags_;
+		Iso8601Format iso8601_;
+	};
+
+	inline void writeString(JsonWriter & writer, std::string const& str) {
+		writer.String(str.data(), static_cast<rapidjson::SizeType>(str.size()));
+	}
+
+	inline void writeString(JsonWriter & writer, SPL::ustring const& str) {
+		writer.String(str.getBuffer(), static_cast<rapidjson::SizeType>(str.length()));
+	}
+
+	inline void writeString(JsonWriter & writer, SPL::ConstValueHandle const& valueHandle) {
 		switch(valueHandle.getMetaType()) {
 			case SPL::Meta::Type::BSTRING : {
 				const SPL::BString & str = valueHandle;
-				return str.getCString();
+				writer.String(str.getCString(), static_cast<rapidjson::SizeType>(str.getUsedSize()));
+				break;
 			}
 			case SPL::Meta::Type::USTRING : {
 				const SPL::ustring & str = valueHandle;
-				return SPL::spl_cast<SPL::rstring,SPL::ustring>::cast(str).c_str();
+				writeString(writer, str);
+				break;
 			}
 			default: {
 				const SPL::rstring & str = valueHandle;
-				return str.c_str();
+				writeString(writer, str);
 			}
 		}
 	}
 
 
 	template<typename Container, typename Iterator>
-	inline void writeArray(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+	inline void writeArray(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
 
 	template<typename Container, typename Iterator>
-	inline void writeMap(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+	inline void writeMap(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+
+	inline void writeTuple(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+
+	inline void writePrimitive(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle);
+
+	inline void writePrimitive(JsonWriter & writer, SPL::Meta::Type type, SPL::ConstValueHandle const & valueHandle);
+
+
+	template<typename T>
+	inline bool isDefault(SPL::ConstValueHandle const & valueHandle) {
+		return static_cast<const T&>(valueHandle) == T();
+	}
+
+	/*
+	 * Decides from the meta type whether a tuple attribute or map entry is skipped
+	 * by the omit options, so nothing is written and rolled back:
+	 * - kWriteOmitNulls: absent optionals and the complex and xml values written as null
+	 * - kWriteOmitDefaults: primitives holding the default value of their type,
+	 *   present optionals are kept since their default is absent
+	 * - kWriteOmitEmptyCollections: empty lists, sets and maps, also when optional
+	 */
+	inline bool isOmitted(SPL::Meta::Type type, SPL::ConstValueHandle const & valueHandle, uint32_t flags) {
+
+		switch (type) {
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & optional = valueHandle;
+				if(!optional.isPresent())
+					return (flags & kWriteOmitNulls) != 0;
+				if(!(flags & kWriteOmitEmptyCollections))
+					return false;
+
+				const SPL::ConstValueHandle value = optional.getValue();
+				return isOmitted(value.getMetaType(), value, flags & kWriteOmitEmptyCollections);
+			}
+			case SPL::Meta::Type::COMPLEX32 :
+			case SPL::Meta::Type::COMPLEX64 :
+			case SPL::Meta::Type::XML :
+				return (flags & kWriteOmitNulls) != 0;
+			case SPL::Meta::Type::LIST :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::List &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::BLIST :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::BList &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::SET :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::Set &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::BSET :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::BSet &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::MAP :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::Map &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::BMAP :
+				return (flags & kWriteOmitEmptyCollections) && static_cast<const SPL::BMap &>(valueHandle).getSize() == 0;
+			case SPL::Meta::Type::TUPLE :
+				return false;
+			default:
+				break;
+		}
 
-	inline void writeTuple(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+		if(!(flags & kWriteOmitDefaults))
+			return false;
 
-	inline void writePrimitive(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle);
+		switch (type) {
+			case SPL::Meta::Type::BOOLEAN : return isDefault<SPL::boolean>(valueHandle);
+			case SPL::Meta::Type::ENUM : return static_cast<const SPL::Enum &>(valueHandle).getIndex() == 0;
+			case SPL::Meta::Type::INT8 : return isDefault<SPL::int8>(valueHandle);
+			case SPL::Meta::Type::INT16 : return isDefault<SPL::int16>(valueHandle);
+			case SPL::Meta::Type::INT32 : return isDefault<SPL::int32>(valueHandle);
+			case SPL::Meta::Type::INT64 : return isDefault<SPL::int64>(valueHandle);
+			case SPL::Meta::Type::UINT8 : return isDefault<SPL::uint8>(valueHandle);
+			case SPL::Meta::Type::UINT16 : return isDefault<SPL::uint16>(valueHandle);
+			case SPL::Meta::Type::UINT32 : return isDefault<SPL::uint32>(valueHandle);
+			case SPL::Meta::Type::UINT64 : return isDefault<SPL::uint64>(valueHandle);
+			case SPL::Meta::Type::FLOAT32 : return isDefault<SPL::float32>(valueHandle);
+			case SPL::Meta::Type::FLOAT64 : return isDefault<SPL::float64>(valueHandle);
+			case SPL::Meta::Type::DECIMAL32 : return isDefault<SPL::decimal32>(valueHandle);
+			case SPL::Meta::Type::DECIMAL64 : return isDefault<SPL::decimal64>(valueHandle);
+			case SPL::Meta::Type::DECIMAL128 : return isDefault<SPL::decimal128>(valueHandle);
+			case SPL::Meta::Type::TIMESTAMP : return isDefault<SPL::timestamp>(valueHandle);
+			case SPL::Meta::Type::BSTRING : return static_cast<const SPL::BString &>(valueHandle).getUsedSize() == 0;
+			case SPL::Meta::Type::RSTRING : return static_cast<const SPL::rstring &>(valueHandle).empty();
+			case SPL::Meta::Type::USTRING : return static_cast<const SPL::ustring &>(valueHandle).length() == 0;
+			case SPL::Meta::Type::BLOB : return static_cast<const SPL::blob &>(valueHandle).getSize() == 0;
+			default: return false;
+		}
+	}
 
 
-	inline void writeAny(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+	inline void writeAny(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
 
 		switch (valueHandle.getMetaType()) {
 			case SPL::Meta::Type::LIST : {
@@ -169,8 +522,137 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 		}
 	}
 
+	struct WritePlan;
+
+	inline void writeValue(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+
+	template<typename Container>
+	struct IsSet { static const bool value = false; };
+
+	template<>
+	struct IsSet<SPL::Set> { static const bool value = true; };
+
+	template<>
+	struct IsSet<SPL::BSet> { static const bool value = true; };
+
+	/*
+	 * Byte ranges of a set element or a map member written to a scratch buffer,
+	 * for set elements keyEnd is begin.
+	 */
+	struct CanonicalMember {
+		size_t begin;
+		size_t keyEnd;
+		size_t end;
+	};
+
+	/*
+	 * orders map members by their escaped key and set elements by their JSON text
+	 */
+	class CanonicalMemberOrder {
+	public:
+		CanonicalMemberOrder(const char* base, bool keyed) : base_(base), keyed_(keyed) {}
+
+		bool operator()(CanonicalMember const& a, CanonicalMember const& b) const {
+			const size_t lengthA = (keyed_ ? a.keyEnd : a.end) - a.begin;
+			const size_t lengthB = (keyed_ ? b.keyEnd : b.end) - b.begin;
+
+			const int order = std::memcmp(base_ + a.begin, base_ + b.begin, lengthA < lengthB ? lengthA : lengthB);
+			return order < 0 || (order == 0 && lengthA < lengthB);
+		}
+
+	private:
+		const char* base_;
+		bool keyed_;
+	};
+
+	inline void writeMember(JsonWriter & writer, WritePlan const* plan, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		if(plan)
+			writeValue(writer, *plan, valueHandle, prefixToIgnore);
+		else
+			writeAny(writer, valueHandle, prefixToIgnore);
+	}
+
+	/*
+	 * Sets and maps iterate in hash order, with kWriteCanonical set elements are
+	 * sorted by their JSON text and map members by their escaped key. The members
+	 * are written to a scratch buffer with the writer's flags and copied in order.
+	 * Without element plan the members are written by writeAny.
+	 */
+	template<typename Container, typename Iterator>
+	inline void writeCanonicalSet(JsonWriter & writer, WritePlan const* element, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		rapidjson::StringBuffer buffer;
+		JsonWriter elements(buffer);
+		elements.SetFlags(writer.GetFlags());
+		std::vector<CanonicalMember> members;
+
+		const Container & set = valueHandle;
+		for(Iterator setIter = set.getBeginIterator(); setIter != set.getEndIterator(); setIter++) {
+			CanonicalMember member;
+			member.begin = member.keyEnd = buffer.GetSize();
+			writeMember(elements, element, *setIter, prefixToIgnore);
+			elements.Reset(buffer);
+			member.end = buffer.GetSize();
+
+			members.push_back(member);
+		}
+
+		const char* base = buffer.GetString();
+		std::sort(members.begin(), members.end(), CanonicalMemberOrder(base, false));
+
+		writer.StartArray();
+		for(std::vector<CanonicalMember>::const_iterator it = members.begin(); it != members.end(); ++it)
+			writer.RawValue(base + it->begin, it->end - it->begin, rapidjson::kObjectType);
+		writer.EndArray();
+	}
+
+	template<typename Container, typename Iterator>
+	inline void writeCanonicalMap(JsonWriter & writer, WritePlan const* element, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		const uint32_t omit = writer.GetFlags() & kWriteOmitMask;
+
+		rapidjson::StringBuffer buffer;
+		JsonWriter entries(buffer);
+		entries.SetFlags(writer.GetFlags());
+		std::vector<CanonicalMember> members;
+
+		const Container & map = valueHandle;
+		for(Iterator mapIter = map.getBeginIterator(); mapIter != map.getEndIterator(); mapIter++) {
+
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & mapHandle = *mapIter;
+			if(omit && isOmitted(mapHandle.second.getMetaType(), mapHandle.second, omit))
+				continue;
+
+			CanonicalMember member;
+			member.begin = buffer.GetSize();
+			writeString(entries, mapHandle.first);
+			entries.Reset(buffer);
+			member.keyEnd = buffer.GetSize();
+			writeMember(entries, element, mapHandle.second, prefixToIgnore);
+			entries.Reset(buffer);
+			member.end = buffer.GetSize();
+
+			members.push_back(member);
+		}
+
+		const char* base = buffer.GetString();
+		std::sort(members.begin(), members.end(), CanonicalMemberOrder(base, true));
+
+		writer.StartObject();
+		for(std::vector<CanonicalMember>::const_iterator it = members.begin(); it != members.end(); ++it) {
+			writer.RawKey(base + it->begin, it->keyEnd - it->begin);
+			writer.RawValue(base + it->keyEnd, it->end - it->keyEnd, rapidjson::kObjectType);
+		}
+		writer.EndObject();
+	}
+
 	template<typename Container, typename Iterator>
-	inline void writeArray(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+	inline void writeArray(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		if(IsSet<Container>::value && (writer.GetFlags() & kWriteCanonical)) {
+			writeCanonicalSet<Container,Iterator>(writer, 0, valueHandle, prefixToIgnore);
+			return;
+		}
 
 		writer.StartArray();
 
@@ -185,7 +667,14 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 	}
 
 	template<typename Container, typename Iterator>
-	inline void writeMap(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+	inline void writeMap(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		if(writer.GetFlags() & kWriteCanonical) {
+			writeCanonicalMap<Container,Iterator>(writer, 0, valueHandle, prefixToIgnore);
+			return;
+		}
+
+		const uint32_t omit = writer.GetFlags() & kWriteOmitMask;
 
 		writer.StartObject();
 
@@ -194,41 +683,106 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 
 			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & mapHandle = *mapIter;
 			const SPL::ConstValueHandle & mapValueHandle = mapHandle.second;
+			if(omit && isOmitted(mapValueHandle.getMetaType(), mapValueHandle, omit))
+				continue;
 
-			writer.String(convToChars(mapHandle.first));
+			writeString(writer, mapHandle.first);
 			writeAny(writer, mapValueHandle, prefixToIgnore);
 		}
 
 		writer.EndObject();
 	}
 
-	inline void writeTuple(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
-		using namespace streams_boost::algorithm;
+	/*
+	 * checks the JSON number syntax: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+	 */
+	inline bool isJsonNumber(std::string const& str) {
+		const char* p = str.c_str();
 
-		writer.StartObject();
+		if(*p == '-')
+			p++;
+		if(*p == '0')
+			p++;
+		else if(*p >= '1' && *p <= '9')
+			while(*p >= '0' && *p <= '9') p++;
+		else
+			return false;
 
-		const SPL::Tuple & tuple = valueHandle;
-		for(SPL::ConstTupleIterator tupleIter = tuple.getBeginIterator(); tupleIter != tuple.getEndIterator(); tupleIter++) {
+		if(*p == '.') {
+			p++;
+			if(!(*p >= '0' && *p <= '9'))
+				return false;
+			while(*p >= '0' && *p <= '9') p++;
+		}
+
+		if(*p == 'e' || *p == 'E') {
+			p++;
+			if(*p == '+' || *p == '-')
+				p++;
+			if(!(*p >= '0' && *p <= '9'))
+				return false;
+			while(*p >= '0' && *p <= '9') p++;
+		}
 
-			const std::string & attrName = (*tupleIter).getName();
-			const SPL::ConstValueHandle & attrValueHandle = static_cast<SPL::ConstTupleAttribute>(*tupleIter).getValue();
+		return p == str.c_str() + str.size();
+	}
 
-			if(!prefixToIgnore.empty() && starts_with(attrName, prefixToIgnore)) {
-				writer.String(convToChars(replace_first_copy(attrName, prefixToIgnore, "")));
-			}
-			else {
-				writer.String(convToChars(attrName));
-			}
+	/*
+	 * decimals are written exactly from their decimal string representation,
+	 * as JSON number or with kWriteDecimalAsString as JSON string.
+	 * NaN and infinity have no JSON number representation and are written as null.
+	 * With kWriteCanonical trailing zeros and exponents are normalized away.
+	 */
+	template<typename Decimal>
+	inline void writeDecimal(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle) {
+		const Decimal & value = valueHandle;
+		SPL::rstring str = SPL::spl_cast<SPL::rstring,Decimal>::cast(value);
+
+		// the canonical form of a number is a number again, so the syntax is checked once
+		const bool isNumber = isJsonNumber(str);
+		if(isNumber && (writer.GetFlags() & kWriteCanonical))
+			str = canonicalNumber(str);
+
+		if(writer.GetFlags() & kWriteDecimalAsString)
+			writeString(writer, str);
+		else if(isNumber)
+			writer.RawValue(str.data(), str.size(), rapidjson::kNumberType);
+		else
+			writer.Null();
+	}
+
+	/*
+	 * timestamps are written as ctime string unless one of the timestamp
+	 * options is set, ISO-8601 takes precedence over epoch nanoseconds
+	 * and epoch nanoseconds over epoch milliseconds. Epoch nanoseconds
+	 * outside of the int64 range are written as epoch milliseconds and
+	 * epoch milliseconds outside of the int64 range as ISO-8601 string.
+	 */
+	inline void writeTimestamp(JsonWriter & writer, SPL::timestamp const & value) {
+		const uint32_t flags = writer.GetFlags();
+		int64_t nanos, millis;
 
-			writeAny(writer, attrValueHandle, prefixToIgnore);
+		if(flags & kWriteTimestampISO8601)
+			writer.Iso8601(value.getSeconds(), value.getNanoseconds());
+		else if((flags & kWriteTimestampEpochNanos) && epochNanos(value.getSeconds(), value.getNanoseconds(), nanos))
+			writer.Int64(nanos);
+		else if(flags & (kWriteTimestampEpochMillis | kWriteTimestampEpochNanos)) {
+			if(epochMillis(value.getSeconds(), value.getNanoseconds(), millis))
+				writer.Int64(millis);
+			else
+				writer.Iso8601(value.getSeconds(), value.getNanoseconds());
 		}
+		else
+			writeString(writer, SPL::Functions::Time::ctime(value));
+	}
 
-		writer.EndObject();
+	inline void writePrimitive(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle) {
+		writePrimitive(writer, valueHandle.getMetaType(), valueHandle);
 	}
 
-	inline void writePrimitive(rapidjson::Writer<rapidjson::StringBuffer> & writer, SPL::ConstValueHandle const & valueHandle) {
+	inline void writePrimitive(JsonWriter & writer, SPL::Meta::Type type, SPL::ConstValueHandle const & valueHandle) {
 
-		switch (valueHandle.getMetaType()) {
+		switch (type) {
 			case SPL::Meta::Type::BOOLEAN : {
 				const SPL::boolean & value = valueHandle;
 				writer.Bool(value);
@@ -236,7 +790,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 			}
 			case SPL::Meta::Type::ENUM : {
 				const SPL::Enum & value = valueHandle;
-				writer.String(convToChars(value.getValue()));
+				writeString(writer, value.getValue());
 				break;
 			}
 			case SPL::Meta::Type::INT8 : {
@@ -281,7 +835,7 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 			}
 			case SPL::Meta::Type::FLOAT32 : {
 				const SPL::float32 & value = valueHandle;
-				writer.Double(value);
+				writer.Float(value);
 				break;
 			}
 			case SPL::Meta::Type::FLOAT64 : {
@@ -290,18 +844,15 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 				break;
 			}
 			case SPL::Meta::Type::DECIMAL32 : {
-				const SPL::float64 & value = SPL::spl_cast<SPL::float64,SPL::decimal32>::cast(valueHandle);
-				writer.Double(value);
+				writeDecimal<SPL::decimal32>(writer, valueHandle);
 				break;
 			}
 			case SPL::Meta::Type::DECIMAL64 : {
-				const SPL::float64 & value = SPL::spl_cast<SPL::float64,SPL::decimal64>::cast(valueHandle);
-				writer.Double(value);
+				writeDecimal<SPL::decimal64>(writer, valueHandle);
 				break;
 			}
 			case SPL::Meta::Type::DECIMAL128 : {
-				const SPL::float64 & value = SPL::spl_cast<SPL::float64,SPL::decimal128>::cast(valueHandle);
-				writer.Double(value);
+				writeDecimal<SPL::decimal128>(writer, valueHandle);
 				break;
 			}
 			case SPL::Meta::Type::COMPLEX32 : {
@@ -313,18 +864,18 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 				break;
 			}
 			case SPL::Meta::Type::TIMESTAMP : {
-				const SPL::timestamp & value = valueHandle;
-				writer.String(convToChars(SPL::Functions::Time::ctime(value)));
+				writeTimestamp(writer, valueHandle);
 				break;
 			}
 			case SPL::Meta::Type::BSTRING :
 			case SPL::Meta::Type::RSTRING :
 			case SPL::Meta::Type::USTRING : {
-				writer.String(convToChars(valueHandle));
+				writeString(writer, valueHandle);
 				break;
 			}
 			case SPL::Meta::Type::BLOB : {
-				writer.Null();
+				const SPL::blob & value = valueHandle;
+				writer.Base64(value.getData(), value.getSize());
 				break;
 			}
 			case SPL::Meta::Type::XML : {
@@ -337,70 +888,1284 @@ namespace com { namespace ibm { namespace streamsx { namespace json {
 	}
 
 
-	inline SPL::rstring tupleToJSON(SPL::Tuple const& tuple, SPL::rstring prefixToIgnore = "") {
+	/*
+	 * Serialization plan of an SPL type, built once from the type's meta data.
+	 * It holds the meta type of every value and for tuples the escaped and quoted
+	 * keys, so the plan is run without dispatching on each value's meta type.
+	 * An optional holding a composite type that was null when the plan was built
+	 * has no element plan, its values are written by writeAny instead and
+	 * encoded by the binary encodings with the cached plan of their type.
+	 */
+	struct WritePlan {
+
+		explicit WritePlan(SPL::Meta::Type _type) : type(_type), element(0) {}
+
+		~WritePlan() {
+			delete element;
+			for(std::vector<WritePlan*>::iterator it = attributes.begin(); it != attributes.end(); ++it)
+				delete *it;
+		}
+
+		// meta type of the value
+		SPL::Meta::Type type;
+		// plan of the list or set element, map value or optional value
+		WritePlan* element;
+		// keys and plans of the tuple attributes, indexed by attribute position
+		std::vector<std::string> keys;
+		// unquoted keys of the tuple attributes, for the binary encodings
+		std::vector<std::string> names;
+		std::vector<WritePlan*> attributes;
+
+	private:
+		WritePlan(WritePlan const&);
+		WritePlan& operator=(WritePlan const&);
+	};
+
+	inline std::string buildName(std::string const& attrName, SPL::rstring const& prefixToIgnore) {
+		using namespace streams_boost::algorithm;
+
+		if(!prefixToIgnore.empty() && starts_with(attrName, prefixToIgnore))
+			return replace_first_copy(attrName, prefixToIgnore, "");
+
+		return attrName;
+	}
 
-	    rapidjson::StringBuffer s;
-	    rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+	inline std::string buildKey(std::string const& name) {
+		rapidjson::StringBuffer s;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(s);
 
-		writeAny(writer, SPL::ConstValueHandle(tuple), prefixToIgnore);
+		writer.String(name.data(), static_cast<rapidjson::SizeType>(name.size()));
 
-		return s.GetString();
+		return std::string(s.GetString(), s.GetSize());
 	}
 
-	template<class MAP>
-	inline SPL::rstring mapToJSON(MAP const& map, SPL::rstring prefixToIgnore = "") {
+	inline WritePlan* buildWritePlan(SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore);
+
+	template<typename Collection>
+	inline WritePlan* buildElementPlan(SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		SPL::ValueHandle elementHandle = static_cast<const Collection&>(valueHandle).createElement();
+		WritePlan* plan = buildWritePlan(elementHandle, prefixToIgnore);
+		elementHandle.deleteValue();
+
+		return plan;
+	}
 
-	    rapidjson::StringBuffer s;
-	    rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+	template<typename Container>
+	inline WritePlan* buildMapValuePlan(SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		SPL::ValueHandle mapValueHandle = static_cast<const Container&>(valueHandle).createValue();
+		WritePlan* plan = buildWritePlan(mapValueHandle, prefixToIgnore);
+		mapValueHandle.deleteValue();
 
-		writeAny(writer, SPL::ConstValueHandle(map), prefixToIgnore);
+		return plan;
+	}
+
+	inline WritePlan* buildWritePlan(SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		WritePlan* plan = new WritePlan(valueHandle.getMetaType());
+
+		switch (plan->type) {
+			case SPL::Meta::Type::LIST : {
+				plan->element = buildElementPlan<SPL::List>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BLIST : {
+				plan->element = buildElementPlan<SPL::BList>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::SET : {
+				plan->element = buildElementPlan<SPL::Set>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BSET : {
+				plan->element = buildElementPlan<SPL::BSet>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::MAP : {
+				plan->element = buildMapValuePlan<SPL::Map>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BMAP : {
+				plan->element = buildMapValuePlan<SPL::BMap>(valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::TUPLE : {
+				const SPL::Tuple & tuple = valueHandle;
+				uint32_t attrCount = tuple.getNumberOfAttributes();
+
+				for(uint32_t i = 0; i < attrCount; i++) {
+					plan->names.push_back(buildName(tuple.getAttributeName(i), prefixToIgnore));
+					plan->keys.push_back(buildKey(plan->names.back()));
+					plan->attributes.push_back(buildWritePlan(tuple.getAttributeValue(i), prefixToIgnore));
+				}
+				break;
+			}
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & optional = valueHandle;
+
+				if(optional.isPresent()) {
+					plan->element = buildWritePlan(optional.getValue(), prefixToIgnore);
+				}
+				else {
+					switch (optional.getValueMetaType()) {
+						case SPL::Meta::Type::LIST :
+						case SPL::Meta::Type::BLIST :
+						case SPL::Meta::Type::SET :
+						case SPL::Meta::Type::BSET :
+						case SPL::Meta::Type::MAP :
+						case SPL::Meta::Type::BMAP :
+						case SPL::Meta::Type::TUPLE :
+						case SPL::Meta::Type::OPTIONAL :
+							break;
+						default:
+							plan->element = new WritePlan(optional.getValueMetaType());
+					}
+				}
+				break;
+			}
+			default:
+				break;
+		}
 
-		return s.GetString();
+		return plan;
 	}
 
 	/*
-	 * overwrite the mapToJSON for optional map types
-	 *
-	 * works exactly as mapToJSON except the case where the
-	 * the parameter value is null. In this case an empty object
-	 * represented by {} will be generated, to get a valid JSON
-	 * string. It is the same as for an empty map. SO one can
-	 * never reinterpret this one to a map type with NULL value.
+	 * Plans are built once per SPL type and prefixToIgnore and shared by all threads.
+	 * Each thread keeps its own lookup cache, so the registry is locked only on a cache miss.
 	 */
-	template<class MAP>
-	inline SPL::rstring mapToJSON(SPL::optional<MAP> const& map, SPL::rstring prefixToIgnore = "") {
+	class WritePlanRegistry {
+	public:
+		~WritePlanRegistry() {
+			for(Plans::iterator it = plans_.begin(); it != plans_.end(); ++it)
+				delete it->second;
+		}
 
-	    rapidjson::StringBuffer s;
-	    rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+		WritePlan const& get(std::type_info const& type, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+			streams_boost::mutex::scoped_lock lock(mutex_);
 
-		if (((const SPL::Optional&)SPL::ConstValueHandle(map)).isPresent()) {
-			writeAny(writer, SPL::ConstValueHandle(map), prefixToIgnore);
-		}
-		else {
-			writer.StartObject();
-			writer.EndObject();
+			Key key(type.name(), prefixToIgnore);
+			Plans::iterator it = plans_.find(key);
+			if(it == plans_.end()) {
+				it = plans_.insert(std::make_pair(key, buildWritePlan(valueHandle, prefixToIgnore))).first;
+			}
+
+			return *it->second;
 		}
 
-		return s.GetString();
-	}
+	private:
+		typedef std::pair<std::string, std::string> Key;
+		typedef std::map<Key, WritePlan*> Plans;
 
+		streams_boost::mutex mutex_;
+		Plans plans_;
+	};
 
-	template<class String, class SPLAny>
-	inline SPL::rstring toJSON(String const& key, SPLAny const& splAny, SPL::rstring prefixToIgnore = "") {
+	/*
+	 * Moving average of the output sizes written for one type,
+	 * each new size is weighted with 1/8.
+	 */
+	struct SizeEstimate {
 
+		SizeEstimate() : average(0), samples(0) {}
 
-	    rapidjson::StringBuffer s;
-	    rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+		void update(size_t size) {
+			average = samples ? average + (static_cast<double>(size) - average) / 8 : static_cast<double>(size);
+			samples++;
+		}
 
-		writer.StartObject();
+		size_t expected() const { return static_cast<size_t>(average); }
 
-		writer.String(convToChars(key));
+		double average;
+		uint64_t samples;
+	};
 
-		writeAny(writer, SPL::ConstValueHandle(splAny), prefixToIgnore);
+	/*
+	 * Entry of the per thread plan cache, a plan together with
+	 * the size estimate of the values this thread wrote with it.
+	 */
+	struct PlanUse {
 
-		writer.EndObject();
+		PlanUse(SPL::rstring const& _prefixToIgnore, WritePlan const* _plan) : prefixToIgnore(_prefixToIgnore), plan(_plan) {}
+
+		std::string prefixToIgnore;
+		WritePlan const* plan;
+		SizeEstimate size;
+	};
+
+	inline PlanUse & getPlanUse(std::type_info const& type, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		typedef std::vector<PlanUse> PrefixPlans;
+		typedef std::map<const std::type_info*, PrefixPlans> PlanCache;
+		static WritePlanRegistry registry;
+		static streams_boost::thread_specific_ptr<PlanCache> cachePtr_;
+
+		PlanCache * cache = cachePtr_.get();
+		if(!cache) {
+			cachePtr_.reset(new PlanCache());
+			cache = cachePtr_.get();
+		}
+
+		// the prefixes used with one type are few, so they are searched linearly
+		PrefixPlans & plans = (*cache)[&type];
+		for(PrefixPlans::iterator it = plans.begin(); it != plans.end(); ++it) {
+			if(it->prefixToIgnore == prefixToIgnore)
+				return *it;
+		}
+
+		WritePlan const& plan = registry.get(type, valueHandle, prefixToIgnore);
+		plans.push_back(PlanUse(prefixToIgnore, &plan));
+
+		return plans.back();
+	}
+
+	inline WritePlan const& getWritePlan(std::type_info const& type, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		return *getPlanUse(type, valueHandle, prefixToIgnore).plan;
+	}
+
+	template<typename Container, typename Iterator>
+	inline void writeArray(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		if(IsSet<Container>::value && (writer.GetFlags() & kWriteCanonical)) {
+			writeCanonicalSet<Container,Iterator>(writer, plan.element, valueHandle, prefixToIgnore);
+			return;
+		}
+
+		writer.StartArray();
+
+		const Container & array = valueHandle;
+		for(Iterator arrayIter = array.getBeginIterator(); arrayIter != array.getEndIterator(); arrayIter++) {
+			writeValue(writer, *plan.element, *arrayIter, prefixToIgnore);
+		}
+
+		writer.EndArray();
+	}
+
+	template<typename Container, typename Iterator>
+	inline void writeMap(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		if(writer.GetFlags() & kWriteCanonical) {
+			writeCanonicalMap<Container,Iterator>(writer, plan.element, valueHandle, prefixToIgnore);
+			return;
+		}
+
+		const uint32_t omit = writer.GetFlags() & kWriteOmitMask;
+
+		writer.StartObject();
+
+		const Container & map = valueHandle;
+		for(Iterator mapIter = map.getBeginIterator(); mapIter != map.getEndIterator(); mapIter++) {
+
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & mapHandle = *mapIter;
+			if(omit && isOmitted(plan.element->type, mapHandle.second, omit))
+				continue;
+
+			writeString(writer, mapHandle.first);
+			writeValue(writer, *plan.element, mapHandle.second, prefixToIgnore);
+		}
+
+		writer.EndObject();
+	}
+
+	template<typename T>
+	inline bool isFinite(T) { return true; }
+
+	inline bool isFinite(float value) { return !rapidjson::internal::Double(value).IsNanOrInf(); }
+
+	inline bool isFinite(double value) { return !rapidjson::internal::Double(value).IsNanOrInf(); }
+
+	/*
+	 * A list of a numeric type is a vector, it is written by NumberArray in one go.
+	 * Lists holding NaN or infinity are left to the element wise path.
+	 */
+	template<typename T>
+	inline bool writeNumberList(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle) {
+		const SPL::list<T> & values = valueHandle;
+
+		for(typename SPL::list<T>::const_iterator it = values.begin(); it != values.end(); ++it) {
+			if(!isFinite(*it))
+				return false;
+		}
+
+		writer.NumberArray(values.empty() ? 0 : &values[0], values.size());
+		return true;
+	}
+
+	inline bool writeNumberList(JsonWriter & writer, SPL::Meta::Type elementType, SPL::ConstValueHandle const & valueHandle) {
+
+		switch (elementType) {
+			case SPL::Meta::Type::INT8 : return writeNumberList<SPL::int8>(writer, valueHandle);
+			case SPL::Meta::Type::INT16 : return writeNumberList<SPL::int16>(writer, valueHandle);
+			case SPL::Meta::Type::INT32 : return writeNumberList<SPL::int32>(writer, valueHandle);
+			case SPL::Meta::Type::INT64 : return writeNumberList<SPL::int64>(writer, valueHandle);
+			case SPL::Meta::Type::UINT8 : return writeNumberList<SPL::uint8>(writer, valueHandle);
+			case SPL::Meta::Type::UINT16 : return writeNumberList<SPL::uint16>(writer, valueHandle);
+			case SPL::Meta::Type::UINT32 : return writeNumberList<SPL::uint32>(writer, valueHandle);
+			case SPL::Meta::Type::UINT64 : return writeNumberList<SPL::uint64>(writer, valueHandle);
+			case SPL::Meta::Type::FLOAT32 : return writeNumberList<SPL::float32>(writer, valueHandle);
+			case SPL::Meta::Type::FLOAT64 : return writeNumberList<SPL::float64>(writer, valueHandle);
+			default: return false;
+		}
+	}
+
+	inline void writeValue(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		switch (plan.type) {
+			case SPL::Meta::Type::LIST : {
+				if(!writeNumberList(writer, plan.element->type, valueHandle))
+					writeArray<SPL::List,SPL::ConstListIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BLIST : {
+				writeArray<SPL::BList,SPL::ConstListIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::SET : {
+				writeArray<SPL::Set,SPL::ConstSetIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BSET : {
+				writeArray<SPL::BSet,SPL::ConstSetIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::MAP : {
+				writeMap<SPL::Map,SPL::ConstMapIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::BMAP : {
+				writeMap<SPL::BMap,SPL::ConstMapIterator>(writer, plan, valueHandle, prefixToIgnore);
+				break;
+			}
+			case SPL::Meta::Type::TUPLE : {
+				const uint32_t omit = writer.GetFlags() & kWriteOmitMask;
+
+				writer.StartObject();
+
+				const SPL::Tuple & tuple = valueHandle;
+				for(uint32_t i = 0; i < plan.keys.size(); i++) {
+					if(omit && isOmitted(plan.attributes[i]->type, tuple.getAttributeValue(i), omit))
+						continue;
+
+					writer.RawKey(plan.keys[i].data(), plan.keys[i].size());
+					writeValue(writer, *plan.attributes[i], tuple.getAttributeValue(i), prefixToIgnore);
+				}
+
+				writer.EndObject();
+				break;
+			}
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & optional = valueHandle;
+
+				// write null if optional is not present
+				if(!optional.isPresent())
+					writer.Null();
+				else if(plan.element)
+					writeValue(writer, *plan.element, optional.getValue(), prefixToIgnore);
+				else
+					writeAny(writer, optional.getValue(), prefixToIgnore);
+				break;
+			}
+			default:
+				writePrimitive(writer, plan.type, valueHandle);
+		}
+	}
+
+	inline void writeTuple(JsonWriter & writer, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+
+		const SPL::Tuple & tuple = valueHandle;
+		writeValue(writer, getWritePlan(typeid(tuple), valueHandle, prefixToIgnore), valueHandle, prefixToIgnore);
+	}
+
+
+	inline size_t stringSizeBound(SPL::ConstValueHandle const& valueHandle) {
+		// an escaped character takes at most 6 output bytes, so does a UTF-16 code unit
+		switch(valueHandle.getMetaType()) {
+			case SPL::Meta::Type::BSTRING : return 2 + 6 * static_cast<const SPL::BString &>(valueHandle).getUsedSize();
+			case SPL::Meta::Type::USTRING : return 2 + 6 * static_cast<size_t>(static_cast<const SPL::ustring &>(valueHandle).length());
+			case SPL::Meta::Type::RSTRING : return 2 + 6 * static_cast<const SPL::rstring &>(valueHandle).size();
+			default: return kMaxDoubleLength;
+		}
+	}
+
+	inline size_t jsonSizeBound(WritePlan const& plan, SPL::ConstValueHandle const & valueHandle);
+
+	template<typename Collection, typename Iterator>
+	inline size_t arraySizeBound(WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+		const Collection & collection = valueHandle;
+		size_t size = 2;
+		for(Iterator it = collection.getBeginIterator(); it != collection.getEndIterator(); it++)
+			size += jsonSizeBound(*plan.element, *it) + 1;
+		return size;
+	}
+
+	template<typename Container, typename Iterator>
+	inline size_t mapSizeBound(WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+		const Container & map = valueHandle;
+		size_t size = 2;
+		for(Iterator it = map.getBeginIterator(); it != map.getEndIterator(); it++) {
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & entry = *it;
+			size += stringSizeBound(entry.first) + 1 + jsonSizeBound(*plan.element, entry.second) + 1;
+		}
+		return size;
+	}
+
+	/*
+	 * Upper bound of the JSON size of a value, computed from the collection sizes
+	 * and string lengths without formatting anything. Optional composite values
+	 * without element plan (see WritePlan) are counted as null.
+	 */
+	inline size_t jsonSizeBound(WritePlan const& plan, SPL::ConstValueHandle const & valueHandle) {
+
+		switch (plan.type) {
+			case SPL::Meta::Type::BOOLEAN : return 5;
+			case SPL::Meta::Type::INT8 :
+			case SPL::Meta::Type::INT16 :
+			case SPL::Meta::Type::INT32 :
+			case SPL::Meta::Type::UINT8 :
+			case SPL::Meta::Type::UINT16 :
+			case SPL::Meta::Type::UINT32 : return kMaxInt32Length;
+			case SPL::Meta::Type::INT64 :
+			case SPL::Meta::Type::UINT64 : return kMaxInt64Length;
+			case SPL::Meta::Type::FLOAT32 :
+			case SPL::Meta::Type::FLOAT64 : return kMaxDoubleLength;
+			// 34 digits, sign, point, exponent and quotes
+			case SPL::Meta::Type::DECIMAL32 :
+			case SPL::Meta::Type::DECIMAL64 :
+			case SPL::Meta::Type::DECIMAL128 : return 48;
+			case SPL::Meta::Type::TIMESTAMP : return kMaxIso8601Length;
+			case SPL::Meta::Type::ENUM : return 2 + 6 * static_cast<const SPL::Enum &>(valueHandle).getValue().size();
+			case SPL::Meta::Type::BSTRING :
+			case SPL::Meta::Type::RSTRING :
+			case SPL::Meta::Type::USTRING : return stringSizeBound(valueHandle);
+			case SPL::Meta::Type::BLOB : return 2 + base64EncodedLength(static_cast<const SPL::blob &>(valueHandle).getSize());
+			case SPL::Meta::Type::LIST : return arraySizeBound<SPL::List,SPL::ConstListIterator>(plan, valueHandle);
+			case SPL::Meta::Type::BLIST : return arraySizeBound<SPL::BList,SPL::ConstListIterator>(plan, valueHandle);
+			case SPL::Meta::Type::SET : return arraySizeBound<SPL::Set,SPL::ConstSetIterator>(plan, valueHandle);
+			case SPL::Meta::Type::BSET : return arraySizeBound<SPL::BSet,SPL::ConstSetIterator>(plan, valueHandle);
+			case SPL::Meta::Type::MAP : return mapSizeBound<SPL::Map,SPL::ConstMapIterator>(plan, valueHandle);
+			case SPL::Meta::Type::BMAP : return mapSizeBound<SPL::BMap,SPL::ConstMapIterator>(plan, valueHandle);
+			case SPL::Meta::Type::TUPLE : {
+				const SPL::Tuple & tuple = valueHandle;
+				size_t size = 2;
+				for(uint32_t i = 0; i < plan.keys.size(); i++)
+					size += plan.keys[i].size() + 1 + jsonSizeBound(*plan.attributes[i], tuple.getAttributeValue(i)) + 1;
+				return size;
+			}
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & optional = valueHandle;
+				if(optional.isPresent() && plan.element)
+					return jsonSizeBound(*plan.element, optional.getValue());
+				return 4;
+			}
+			default:
+				return 4;
+		}
+	}
+
+	/*
+	 * Reserves the output for a value before it is written: the moving average of the
+	 * sizes this thread wrote for the type with some headroom, or the upper bound for
+	 * the first value. Growing the buffer while writing is the exception this way.
+	 */
+	inline void reserveOutput(rapidjson::StringBuffer & buffer, PlanUse const& use, SPL::ConstValueHandle const & valueHandle) {
+		if(use.size.samples)
+			buffer.Reserve(use.size.expected() + use.size.expected() / 4);
+		else
+			buffer.Reserve(jsonSizeBound(*use.plan, valueHandle));
+	}
+
+	/*
+	 * writes a value with the plan of its type and updates the size estimate
+	 */
+	inline void writeValue(JsonWriter & writer, rapidjson::StringBuffer & buffer, PlanUse & use, SPL::ConstValueHandle const & valueHandle, SPL::rstring const& prefixToIgnore) {
+		const size_t start = buffer.GetSize();
+
+		reserveOutput(buffer, use, valueHandle);
+		writeValue(writer, *use.plan, valueHandle, prefixToIgnore);
+
+		use.size.update(buffer.GetSize() - start);
+	}
+
+	/*
+	 * Output buffer and writer kept per thread. The buffer retains its capacity
+	 * between calls, so it stops growing once it has seen the largest document.
+	 */
+	struct WriterContext {
+
+		WriterContext() : writer(buffer) {}
+
+		SPL::rstring str() const { return SPL::rstring(buffer.GetString(), buffer.GetSize()); }
+		void assignTo(SPL::rstring & str) const { str.assign(buffer.GetString(), buffer.GetSize()); }
+
+		rapidjson::StringBuffer buffer;
+		JsonWriter writer;
+	};
+
+	inline WriterContext & getWriterContext(uint32_t flags = 0) {
+		static streams_boost::thread_specific_ptr<WriterContext> contextPtr_;
+
+		WriterContext * context = contextPtr_.get();
+		if(!context) {
+			contextPtr_.reset(new WriterContext());
+			context = contextPtr_.get();
+		}
+
+		clearBuffer(context->buffer);
+		context->writer.Reset(context->buffer);
+		context->writer.SetFlags(flags);
+
+		return *context;
+	}
+
+
+	inline SPL::rstring tupleToJSON(SPL::Tuple const& tuple, SPL::rstring prefixToIgnore = "", uint32_t flags = 0) {
+
+		WriterContext & context = getWriterContext(flags);
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		writeValue(context.writer, context.buffer, getPlanUse(typeid(tuple), tupleHandle, prefixToIgnore), tupleHandle, prefixToIgnore);
+
+		return context.str();
+	}
+
+	/*
+	 * tupleToJSON writing into a caller provided string, its capacity is reused
+	 */
+	inline void tupleToJSON(SPL::Tuple const& tuple, SPL::rstring & jsonString, SPL::rstring const& prefixToIgnore) {
+
+		WriterContext & context = getWriterContext();
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		writeValue(context.writer, context.buffer, getPlanUse(typeid(tuple), tupleHandle, prefixToIgnore), tupleHandle, prefixToIgnore);
+
+		context.assignTo(jsonString);
+	}
+
+	/*
+	 * Attributes and keys written for a tuple type with an include list and a rename map,
+	 * compiled once per thread from the write plan. Without include list all attributes
+	 * are written in their order, rename entries of other attributes are ignored.
+	 */
+	struct Projection {
+
+		Projection(uint64_t _key, bool _all, SPL::list<SPL::rstring> const& _include, SPL::map<SPL::rstring,SPL::rstring> const& _rename) :
+			key(_key), all(_all), include(_include), rename(_rename) {}
+
+		bool matches(uint64_t _key, bool _all, SPL::list<SPL::rstring> const& _include, SPL::map<SPL::rstring,SPL::rstring> const& _rename) const {
+			return key == _key && all == _all && include == _include && rename == _rename;
+		}
+
+		// hash of the specs, compared before the specs themselves
+		uint64_t key;
+		bool all;
+		SPL::list<SPL::rstring> include;
+		SPL::map<SPL::rstring,SPL::rstring> rename;
+		// attribute positions and quoted keys in output order
+		std::vector<uint32_t> attributes;
+		std::vector<std::string> keys;
+		// size of the JSON this thread wrote with the projection
+		SizeEstimate size;
+	};
+
+	inline void hashSpecString(ContentHash & hash, SPL::rstring const& str) {
+		const uint64_t length = str.size();
+		hash.update(reinterpret_cast<const char*>(&length), sizeof(length));
+		hash.update(str.data(), str.size());
+	}
+
+	/*
+	 * Hash of an include list and a rename map. The rename entries are summed up,
+	 * so equal maps get the same key whatever order they iterate in.
+	 */
+	inline uint64_t projectionKey(bool all, SPL::list<SPL::rstring> const& include, SPL::map<SPL::rstring,SPL::rstring> const& rename) {
+		ContentHash hash;
+		hash.update(all ? "a" : "i", 1);
+
+		for(SPL::list<SPL::rstring>::const_iterator it = include.begin(); it != include.end(); ++it)
+			hashSpecString(hash, *it);
+
+		uint64_t renameSum = 0;
+		for(SPL::map<SPL::rstring,SPL::rstring>::const_iterator it = rename.begin(); it != rename.end(); ++it) {
+			ContentHash entry;
+			hashSpecString(entry, it->first);
+			hashSpecString(entry, it->second);
+			renameSum += entry.finish64();
+		}
+		hash.update(reinterpret_cast<const char*>(&renameSum), sizeof(renameSum));
+
+		return hash.finish64();
+	}
+
+	inline void compileProjection(Projection & projection, SPL::Tuple const& tuple, WritePlan const& plan) {
+
+		std::map<std::string, uint32_t> positions;
+		for(uint32_t i = 0; i < tuple.getNumberOfAttributes(); i++)
+			positions[tuple.getAttributeName(i)] = i;
+
+		if(projection.all) {
+			for(uint32_t i = 0; i < tuple.getNumberOfAttributes(); i++)
+				projection.attributes.push_back(i);
+		}
+		else {
+			for(SPL::list<SPL::rstring>::const_iterator it = projection.include.begin(); it != projection.include.end(); ++it) {
+				std::map<std::string, uint32_t>::const_iterator position = positions.find(*it);
+				if(position == positions.end())
+					THROW(SPL::SPLRuntimeInvalidArgument, "Attribute '" << *it << "' of the include list does not exist in the tuple type");
+
+				projection.attributes.push_back(position->second);
+			}
+		}
+
+		for(std::vector<uint32_t>::const_iterator it = projection.attributes.begin(); it != projection.attributes.end(); ++it) {
+			SPL::map<SPL::rstring,SPL::rstring>::const_iterator renamed = projection.rename.find(tuple.getAttributeName(*it));
+			if(renamed == projection.rename.end())
+				projection.keys.push_back(plan.keys[*it]);
+			else
+				projection.keys.push_back(buildKey(renamed->second));
+		}
+	}
+
+	// number of projections cached per thread and tuple type
+	const size_t kMaxProjections = 16;
+
+	inline Projection & getProjection(SPL::Tuple const& tuple, WritePlan const& plan, bool all, SPL::list<SPL::rstring> const& include, SPL::map<SPL::rstring,SPL::rstring> const& rename) {
+		typedef std::map<const std::type_info*, std::vector<Projection> > ProjectionCache;
+		static streams_boost::thread_specific_ptr<ProjectionCache> cachePtr_;
+
+		ProjectionCache * cache = cachePtr_.get();
+		if(!cache) {
+			cachePtr_.reset(new ProjectionCache());
+			cache = cachePtr_.get();
+		}
+
+		// the specs used with one type are few, they are searched linearly by their key
+		const uint64_t key = projectionKey(all, include, rename);
+		std::vector<Projection> & projections = (*cache)[&typeid(tuple)];
+		for(std::vector<Projection>::iterator it = projections.begin(); it != projections.end(); ++it) {
+			if(it->matches(key, all, include, rename))
+				return *it;
+		}
+
+		// specs computed per tuple would grow the cache without bound, the oldest one is dropped
+		if(projections.size() >= kMaxProjections)
+			projections.erase(projections.begin());
+
+		Projection projection(key, all, include, rename);
+		compileProjection(projection, tuple, plan);
+		projections.push_back(projection);
+
+		return projections.back();
+	}
+
+	inline SPL::rstring projectTupleToJSON(SPL::Tuple const& tuple, bool all, SPL::list<SPL::rstring> const& include, SPL::map<SPL::rstring,SPL::rstring> const& rename) {
+
+		WriterContext & context = getWriterContext();
+		JsonWriter & writer = context.writer;
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		WritePlan const& plan = getWritePlan(typeid(tuple), tupleHandle, "");
+		Projection & projection = getProjection(tuple, plan, all, include, rename);
+
+		// the bound of the whole tuple covers the projection unless renamed keys are longer
+		if(projection.size.samples)
+			context.buffer.Reserve(projection.size.expected() + projection.size.expected() / 4);
+		else
+			context.buffer.Reserve(jsonSizeBound(plan, tupleHandle));
+
+		writer.StartObject();
+
+		for(size_t i = 0; i < projection.attributes.size(); i++) {
+			const uint32_t attribute = projection.attributes[i];
+
+			writer.RawKey(projection.keys[i].data(), projection.keys[i].size());
+			writeValue(writer, *plan.attributes[attribute], tuple.getAttributeValue(attribute), "");
+		}
+
+		writer.EndObject();
+		projection.size.update(context.buffer.GetSize());
+
+		return context.str();
+	}
+
+	/*
+	 * serializes the included attributes of a tuple in the order of the include list
+	 */
+	inline SPL::rstring tupleToJSON(SPL::Tuple const& tuple, SPL::list<SPL::rstring> const& include) {
+		return projectTupleToJSON(tuple, false, include, SPL::map<SPL::rstring,SPL::rstring>());
+	}
+
+	/*
+	 * serializes all attributes of a tuple, the attributes found in the rename map are written with the mapped key
+	 */
+	inline SPL::rstring tupleToJSON(SPL::Tuple const& tuple, SPL::map<SPL::rstring,SPL::rstring> const& rename) {
+		return projectTupleToJSON(tuple, true, SPL::list<SPL::rstring>(), rename);
+	}
+
+	inline SPL::rstring tupleToJSON(SPL::Tuple const& tuple, SPL::list<SPL::rstring> const& include, SPL::map<SPL::rstring,SPL::rstring> const& rename) {
+		return projectTupleToJSON(tuple, false, include, rename);
+	}
+
+	inline void writePatchValue(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & before, SPL::ConstValueHandle const & after);
+
+	/*
+	 * RFC 7386 merge patch of a tuple, only the attributes differing from
+	 * the previous tuple are written, compared on their SPL values
+	 */
+	inline void writeTuplePatch(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & before, SPL::ConstValueHandle const & after) {
+
+		writer.StartObject();
+
+		const SPL::Tuple & previous = before;
+		const SPL::Tuple & current = after;
+		for(uint32_t i = 0; i < plan.keys.size(); i++) {
+			const SPL::ConstValueHandle previousValue = previous.getAttributeValue(i);
+			const SPL::ConstValueHandle currentValue = current.getAttributeValue(i);
+			if(previousValue.equals(currentValue))
+				continue;
+
+			writer.RawKey(plan.keys[i].data(), plan.keys[i].size());
+			writePatchValue(writer, *plan.attributes[i], previousValue, currentValue);
+		}
+
+		writer.EndObject();
+	}
+
+	/*
+	 * merge patch of a map, removed keys are written as null
+	 */
+	template<typename Container, typename Iterator>
+	inline void writeMapPatch(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & before, SPL::ConstValueHandle const & after) {
+
+		writer.StartObject();
+
+		const Container & previous = before;
+		const Container & current = after;
+		for(Iterator mapIter = current.getBeginIterator(); mapIter != current.getEndIterator(); mapIter++) {
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & entry = *mapIter;
+
+			Iterator previousEntry = previous.findElement(entry.first);
+			if(previousEntry == previous.getEndIterator()) {
+				writeString(writer, entry.first);
+				writeValue(writer, *plan.element, entry.second, "");
+			}
+			else if(!(*previousEntry).second.equals(entry.second)) {
+				writeString(writer, entry.first);
+				writePatchValue(writer, *plan.element, (*previousEntry).second, entry.second);
+			}
+		}
+
+		for(Iterator mapIter = previous.getBeginIterator(); mapIter != previous.getEndIterator(); mapIter++) {
+			const std::pair<SPL::ConstValueHandle,SPL::ConstValueHandle> & entry = *mapIter;
+
+			if(current.findElement(entry.first) == current.getEndIterator()) {
+				writeString(writer, entry.first);
+				writer.Null();
+			}
+		}
+
+		writer.EndObject();
+	}
+
+	/*
+	 * Tuples and maps are patched member by member, all other values are replaced,
+	 * lists included as RFC 7386 has no array patches. An absent optional is written
+	 * as null, which removes the member.
+	 */
+	inline void writePatchValue(JsonWriter & writer, WritePlan const& plan, SPL::ConstValueHandle const & before, SPL::ConstValueHandle const & after) {
+
+		switch (plan.type) {
+			case SPL::Meta::Type::TUPLE : {
+				writeTuplePatch(writer, plan, before, after);
+				break;
+			}
+			case SPL::Meta::Type::MAP : {
+				writeMapPatch<SPL::Map,SPL::ConstMapIterator>(writer, plan, before, after);
+				break;
+			}
+			case SPL::Meta::Type::BMAP : {
+				writeMapPatch<SPL::BMap,SPL::ConstMapIterator>(writer, plan, before, after);
+				break;
+			}
+			case SPL::Meta::Type::OPTIONAL : {
+				const SPL::Optional & previous = before;
+				const SPL::Optional & current = after;
+
+				if(previous.isPresent() && current.isPresent() && plan.element)
+					writePatchValue(writer, *plan.element, previous.getValue(), current.getValue());
+				else
+					writeValue(writer, plan, after, "");
+				break;
+			}
+			default:
+				writeValue(writer, plan, after, "");
+		}
+	}
+
+	/*
+	 * Last tuple written per key for merge patch output. The least recently
+	 * used key is evicted when a new key exceeds the capacity.
+	 */
+	template<class T>
+	class PatchHistory {
+	public:
+		struct Entry {
+			Entry(std::string const& _key, T const& _tuple) : key(_key), tuple(_tuple), patches(0) {}
+
+			std::string key;
+			T tuple;
+			// patches written since the last full snapshot
+			uint32_t patches;
+		};
+
+		PatchHistory(uint32_t keyAttribute) : keyAttribute_(keyAttribute), keyWriter_(keyBuffer_) {}
+
+		/*
+		 * the key is the JSON text of the key attribute, so any attribute type can be used
+		 */
+		std::string const& key(WritePlan const& plan, T const& tuple) {
+			keyBuffer_.Clear();
+			keyWriter_.Reset(keyBuffer_);
+			writeValue(keyWriter_, *plan.attributes[keyAttribute_], tuple.getAttributeValue(keyAttribute_), "");
+
+			key_.assign(keyBuffer_.GetString(), keyBuffer_.GetSize());
+			return key_;
+		}
+
+		Entry* find(std::string const& key) {
+			typename Index::iterator it = index_.find(key);
+			if(it == index_.end())
+				return 0;
+
+			entries_.splice(entries_.begin(), entries_, it->second);
+			return &entries_.front();
+		}
+
+		void insert(std::string const& key, T const& tuple, size_t capacity) {
+			while(!entries_.empty() && entries_.size() >= capacity) {
+				index_.erase(entries_.back().key);
+				entries_.pop_back();
+			}
+
+			entries_.push_front(Entry(key, tuple));
+			index_[key] = entries_.begin();
+		}
+
+	private:
+		typedef std::list<Entry> Entries;
+		typedef std::map<std::string, typename Entries::iterator> Index;
+
+		uint32_t keyAttribute_;
+		Entries entries_;
+		Index index_;
+
+		rapidjson::StringBuffer keyBuffer_;
+		JsonWriter keyWriter_;
+		std::string key_;
+	};
+
+	/*
+	 * Histories are kept per thread, tuple type and key attribute.
+	 */
+	template<class T>
+	class PatchHistories : public std::map<std::string, PatchHistory<T>*> {
+	public:
+		~PatchHistories() {
+			for(typename PatchHistories::iterator it = this->begin(); it != this->end(); ++it)
+				delete it->second;
+		}
+	};
+
+	template<class T>
+	inline PatchHistory<T> & getPatchHistory(T const& tuple, SPL::rstring const& keyAttribute) {
+		typedef PatchHistories<T> Histories;
+		static streams_boost::thread_specific_ptr<Histories> historiesPtr_;
+
+		Histories * histories = historiesPtr_.get();
+		if(!histories) {
+			historiesPtr_.reset(new Histories());
+			histories = historiesPtr_.get();
+		}
+
+		PatchHistory<T>* & history = (*histories)[keyAttribute];
+		if(!history) {
+			uint32_t i = 0;
+			while(i < tuple.getNumberOfAttributes() && tuple.getAttributeName(i) != keyAttribute)
+				i++;
+			if(i == tuple.getNumberOfAttributes())
+				THROW(SPL::SPLRuntimeInvalidArgument, "Key attribute '" << keyAttribute << "' does not exist in the tuple type");
+
+			history = new PatchHistory<T>(i);
+		}
+
+		return *history;
+	}
+
+	/*
+	 * Serializes a tuple as RFC 7386 merge patch against the previous tuple with the
+	 * same key attribute value. The first tuple of a key and every snapshotInterval-th
+	 * tuple after it are written in full, a snapshotInterval of 0 writes no snapshots
+	 * after the first. isSnapshot tells whether the tuple was written in full, as a
+	 * patch of unchanged values is just as well a JSON object. At most capacity keys,
+	 * at least one, are remembered per thread.
+	 */
+	template<class T>
+	inline SPL::rstring tupleToJSONPatch(T const& tuple, SPL::rstring const& keyAttribute, SPL::uint32 capacity, SPL::uint32 snapshotInterval, SPL::boolean & isSnapshot) {
+
+		if(capacity == 0)
+			THROW(SPL::SPLRuntimeInvalidArgument, "The capacity of tupleToJSONPatch must be at least 1");
+
+		WriterContext & context = getWriterContext();
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		WritePlan const& plan = getWritePlan(typeid(tuple), tupleHandle, "");
+
+		PatchHistory<T> & history = getPatchHistory(tuple, keyAttribute);
+		std::string const& key = history.key(plan, tuple);
+
+		typename PatchHistory<T>::Entry* entry = history.find(key);
+		if(!entry) {
+			writeValue(context.writer, plan, tupleHandle, "");
+			history.insert(key, tuple, capacity);
+			isSnapshot = true;
+		}
+		else if(snapshotInterval > 0 && entry->patches + 1 >= snapshotInterval) {
+			writeValue(context.writer, plan, tupleHandle, "");
+			entry->tuple = tuple;
+			entry->patches = 0;
+			isSnapshot = true;
+		}
+		else {
+			writeTuplePatch(context.writer, plan, SPL::ConstValueHandle(entry->tuple), tupleHandle);
+			entry->tuple = tuple;
+			entry->patches++;
+			isSnapshot = false;
+		}
+
+		return context.str();
+	}
+
+	template<class T>
+	inline SPL::rstring tupleToJSONPatch(T const& tuple, SPL::rstring const& keyAttribute, SPL::uint32 capacity, SPL::uint32 snapshotInterval) {
+		SPL::boolean isSnapshot;
+		return tupleToJSONPatch(tuple, keyAttribute, capacity, snapshotInterval, isSnapshot);
+	}
+
+	/*
+	 * Formats of tuplesToJSON, the values follow JsonBatchFormat.format
+	 */
+	enum BatchFormat {
+		kBatchArray = 0,
+		kBatchNDJSON = 1,
+		kBatchColumns = 2
+	};
+
+	/*
+	 * A numeric column is gathered into a vector and written by NumberArray.
+	 * Columns holding NaN or infinity are left to the element wise path.
+	 */
+	template<class T, typename Value>
+	inline bool writeNumberColumn(JsonWriter & writer, SPL::list<T> const& tuples, uint32_t attribute) {
+		std::vector<Value> values;
+		values.reserve(tuples.size());
+
+		for(size_t i = 0; i < tuples.size(); i++) {
+			const Value & value = tuples[i].getAttributeValue(attribute);
+			if(!isFinite(value))
+				return false;
+			values.push_back(value);
+		}
+
+		writer.NumberArray(values.empty() ? 0 : &values[0], values.size());
+		return true;
+	}
+
+	template<class T>
+	inline bool writeNumberColumn(JsonWriter & writer, SPL::Meta::Type type, SPL::list<T> const& tuples, uint32_t attribute) {
+
+		switch (type) {
+			case SPL::Meta::Type::INT8 : return writeNumberColumn<T,SPL::int8>(writer, tuples, attribute);
+			case SPL::Meta::Type::INT16 : return writeNumberColumn<T,SPL::int16>(writer, tuples, attribute);
+			case SPL::Meta::Type::INT32 : return writeNumberColumn<T,SPL::int32>(writer, tuples, attribute);
+			case SPL::Meta::Type::INT64 : return writeNumberColumn<T,SPL::int64>(writer, tuples, attribute);
+			case SPL::Meta::Type::UINT8 : return writeNumberColumn<T,SPL::uint8>(writer, tuples, attribute);
+			case SPL::Meta::Type::UINT16 : return writeNumberColumn<T,SPL::uint16>(writer, tuples, attribute);
+			case SPL::Meta::Type::UINT32 : return writeNumberColumn<T,SPL::uint32>(writer, tuples, attribute);
+			case SPL::Meta::Type::UINT64 : return writeNumberColumn<T,SPL::uint64>(writer, tuples, attribute);
+			case SPL::Meta::Type::FLOAT32 : return writeNumberColumn<T,SPL::float32>(writer, tuples, attribute);
+			case SPL::Meta::Type::FLOAT64 : return writeNumberColumn<T,SPL::float64>(writer, tuples, attribute);
+			default: return false;
+		}
+	}
+
+	/*
+	 * writes a list of tuples as one object holding an array per attribute,
+	 * the attribute keys are written once instead of once per tuple
+	 */
+	template<class T>
+	inline void writeColumns(JsonWriter & writer, WritePlan const& plan, SPL::list<T> const& tuples, SPL::rstring const& prefixToIgnore) {
+
+		writer.StartObject();
+
+		for(uint32_t attribute = 0; attribute < plan.keys.size(); attribute++) {
+			writer.RawKey(plan.keys[attribute].data(), plan.keys[attribute].size());
+
+			WritePlan const& column = *plan.attributes[attribute];
+			if(writeNumberColumn(writer, column.type, tuples, attribute))
+				continue;
+
+			writer.StartArray();
+			for(size_t i = 0; i < tuples.size(); i++)
+				writeValue(writer, column, tuples[i].getAttributeValue(attribute), prefixToIgnore);
+			writer.EndArray();
+		}
+
+		writer.EndObject();
+	}
+
+	/*
+	 * serializes a list of tuples into one buffer, as JSON array, as newline delimited
+	 * JSON with one object per line or as one object with a column per attribute.
+	 * The write plan is looked up once and the buffer is reserved for the whole
+	 * batch from the size estimate.
+	 */
+	template<class T>
+	inline SPL::rstring tuplesToJSON(SPL::list<T> const& tuples, BatchFormat format, SPL::rstring const& prefixToIgnore, uint32_t flags) {
+
+		WriterContext & context = getWriterContext(flags);
+		JsonWriter & writer = context.writer;
+
+		if(format == kBatchColumns) {
+			// the keys of an empty batch are taken from a default tuple
+			const T empty;
+			T const& first = tuples.empty() ? empty : tuples[0];
+
+			writeColumns(writer, getWritePlan(typeid(T), SPL::ConstValueHandle(first), prefixToIgnore), tuples, prefixToIgnore);
+			return context.str();
+		}
+
+		if(format == kBatchArray)
+			writer.StartArray();
+
+		if(!tuples.empty()) {
+			PlanUse & use = getPlanUse(typeid(T), SPL::ConstValueHandle(tuples[0]), prefixToIgnore);
+
+			// known types are reserved for the whole batch up front, others after the first tuple
+			if(use.size.samples)
+				context.buffer.Reserve((use.size.expected() + use.size.expected() / 4 + 1) * tuples.size() + 1);
+
+			for(size_t i = 0; i < tuples.size(); i++) {
+				const size_t start = context.buffer.GetSize();
+				writeValue(writer, *use.plan, SPL::ConstValueHandle(tuples[i]), prefixToIgnore);
+				use.size.update(context.buffer.GetSize() - start);
+
+				if(format == kBatchNDJSON) {
+					// each line is a complete JSON text, the writer starts over for the next one
+					writer.Reset(context.buffer);
+					context.buffer.Put('\n');
+				}
+
+				if(i == 0 && use.size.samples == 1 && tuples.size() > 1) {
+					const size_t size = use.size.expected();
+					context.buffer.Reserve((size + size / 4 + 1) * (tuples.size() - 1) + 1);
+				}
+			}
+		}
+
+		if(format == kBatchArray)
+			writer.EndArray();
+
+		return context.str();
+	}
+
+	template<class T, class Format>
+	inline SPL::rstring tuplesToJSON(SPL::list<T> const& tuples, Format const& format, SPL::rstring const& prefixToIgnore = "") {
+		return tuplesToJSON(tuples, static_cast<BatchFormat>(format.getIndex()), prefixToIgnore, 0);
+	}
+
+	template<class MAP>
+	inline SPL::rstring mapToJSON(MAP const& map, SPL::rstring prefixToIgnore = "", uint32_t flags = 0) {
+
+		WriterContext & context = getWriterContext(flags);
+
+		SPL::ConstValueHandle mapHandle(map);
+		writeValue(context.writer, context.buffer, getPlanUse(typeid(MAP), mapHandle, prefixToIgnore), mapHandle, prefixToIgnore);
+
+		return context.str();
+	}
+
+	/*
+	 * overwrite the mapToJSON for optional map types
+	 *
+	 * works exactly as mapToJSON except the case where the
+	 * the parameter value is null. In this case an empty object
+	 * represented by {} will be generated, to get a valid JSON
+	 * string. It is the same as for an empty map. SO one can
+	 * never reinterpret this one to a map type with NULL value.
+	 */
+	template<class MAP>
+	inline SPL::rstring mapToJSON(SPL::optional<MAP> const& map, SPL::rstring prefixToIgnore = "", uint32_t flags = 0) {
+
+		WriterContext & context = getWriterContext(flags);
+		JsonWriter & writer = context.writer;
+
+		SPL::ConstValueHandle mapHandle(map);
+		if (((const SPL::Optional&)mapHandle).isPresent()) {
+			writeValue(writer, context.buffer, getPlanUse(typeid(map), mapHandle, prefixToIgnore), mapHandle, prefixToIgnore);
+		}
+		else {
+			writer.StartObject();
+			writer.EndObject();
+		}
+
+		return context.str();
+	}
+
+
+	template<class String, class SPLAny>
+	inline SPL::rstring toJSON(String const& key, SPLAny const& splAny, SPL::rstring prefixToIgnore = "", uint32_t flags = 0) {
+
+		WriterContext & context = getWriterContext(flags);
+		JsonWriter & writer = context.writer;
+
+		writer.StartObject();
+
+		writeString(writer, key);
+
+		SPL::ConstValueHandle valueHandle(splAny);
+		writeValue(writer, context.buffer, getPlanUse(typeid(SPLAny), valueHandle, prefixToIgnore), valueHandle, prefixToIgnore);
+
+		writer.EndObject();
+
+		return context.str();
+	}
+
+	/*
+	 * expected JSON size of a tuple: the moving average of the sizes written for
+	 * its type by this thread, or the upper bound of the tuple if there are none
+	 */
+	inline SPL::uint64 estimateJSONSize(SPL::Tuple const& tuple, SPL::rstring const& prefixToIgnore = "") {
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		PlanUse const& use = getPlanUse(typeid(tuple), tupleHandle, prefixToIgnore);
+
+		if(use.size.samples)
+			return use.size.expected();
+
+		return jsonSizeBound(*use.plan, tupleHandle);
+	}
+
+	/*
+	 * feeds the hash with the bytes written since the last call, they are dropped
+	 * again unless the caller keeps the JSON
+	 */
+	inline size_t hashOutput(rapidjson::StringBuffer & buffer, size_t hashed, ContentHash & hash, bool keep) {
+		hash.update(buffer.GetString() + hashed, buffer.GetSize() - hashed);
+
+		if(keep)
+			return buffer.GetSize();
+
+		buffer.Clear();
+		return 0;
+	}
+
+	/*
+	 * Writes the canonical JSON of a tuple to the buffer of the thread and hashes it
+	 * attribute by attribute while the bytes are still in cache. Without keep the
+	 * hashed bytes are discarded, the buffer then holds one attribute at most.
+	 */
+	inline WriterContext & writeCanonical(SPL::Tuple const& tuple, ContentHash & hash, bool keep) {
+
+		WriterContext & context = getWriterContext(kWriteCanonical);
+		JsonWriter & writer = context.writer;
+		rapidjson::StringBuffer & buffer = context.buffer;
+
+		SPL::ConstValueHandle tupleHandle(tuple);
+		PlanUse & use = getPlanUse(typeid(tuple), tupleHandle, "");
+		WritePlan const& plan = *use.plan;
+
+		if(keep)
+			reserveOutput(buffer, use, tupleHandle);
+
+		size_t hashed = 0;
+		writer.StartObject();
+
+		for(uint32_t i = 0; i < plan.keys.size(); i++) {
+			writer.RawKey(plan.keys[i].data(), plan.keys[i].size());
+			writeValue(writer, *plan.attributes[i], tuple.getAttributeValue(i), "");
+			hashed = hashOutput(buffer, hashed, hash, keep);
+		}
+
+		writer.EndObject();
+		hashOutput(buffer, hashed, hash, keep);
+
+		if(keep)
+			use.size.update(buffer.GetSize());
+		return context;
+	}
+
+	/*
+	 * canonical JSON of a tuple together with its 64 bit hash
+	 */
+	inline SPL::rstring tupleToJSONWithHash(SPL::Tuple const& tuple, SPL::uint64 & hash) {
+		ContentHash contentHash;
+		WriterContext & context = writeCanonical(tuple, contentHash, true);
+
+		hash = contentHash.finish64();
+		return context.str();
+	}
+
+	/*
+	 * canonical JSON of a tuple together with its 128 bit hash
+	 */
+	inline SPL::rstring tupleToJSONWithHash(SPL::Tuple const& tuple, SPL::uint64 & hashHigh, SPL::uint64 & hashLow) {
+		ContentHash contentHash;
+		WriterContext & context = writeCanonical(tuple, contentHash, true);
+
+		contentHash.finish(hashHigh, hashLow);
+		return context.str();
+	}
+
+	/*
+	 * 64 bit hash of the canonical JSON of a tuple, no string is returned
+	 */
+	inline SPL::uint64 tupleToJSONHash(SPL::Tuple const& tuple) {
+		ContentHash contentHash;
+		writeCanonical(tuple, contentHash, false);
+
+		return contentHash.finish64();
+	}
+
+	inline void tupleToJSONHash(SPL::Tuple const& tuple, SPL::uint64 & hashHigh, SPL::uint64 & hashLow) {
+		ContentHash contentHash;
+		writeCanonical(tuple, contentHash, false);
+
+		contentHash.finish(hashHigh, hashLow);
+	}
+
+	/*
+	 * variants taking a set of JsonWriterOption.option values
+	 */
+	template<class Options>
+	inline SPL::rstring tupleToJSONWithOptions(SPL::Tuple const& tuple, Options const& options) {
+		return tupleToJSON(tuple, "", getWriterFlags(options));
+	}
+
+	template<class Options>
+	inline SPL::rstring tupleToJSONWithOptions(SPL::Tuple const& tuple, SPL::rstring const& prefixToIgnore, Options const& options) {
+		return tupleToJSON(tuple, prefixToIgnore, getWriterFlags(options));
+	}
+
+	template<class T, class Format, class Options>
+	inline SPL::rstring tuplesToJSONWithOptions(SPL::list<T> const& tuples, Format const& format, SPL::rstring const& prefixToIgnore, Options const& options) {
+		return tuplesToJSON(tuples, static_cast<BatchFormat>(format.getIndex()), prefixToIgnore, getWriterFlags(options));
+	}
+
+	template<class MAP, class Options>
+	inline SPL::rstring mapToJSONWithOptions(MAP const& map, SPL::rstring const& prefixToIgnore, Options const& options) {
+		return mapToJSON(map, prefixToIgnore, getWriterFlags(options));
+	}
 
-		return s.GetString();
+	template<class String, class SPLAny, class Options>
+	inline SPL::rstring toJSONWithOptions(String const& key, SPLAny const& splAny, SPL::rstring const& prefixToIgnore, Options const& options) {
+		return toJSON(key, splAny, prefixToIgnore, getWriterFlags(options));
 	}
 
 }}}}